@@ -0,0 +1,633 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "err.h"
+#include "common.h"
+#include "timers.h"
+
+#define EPOLL_BATCH 256
+#define READ_SIZE (64 << 10)
+// A slow reader takes at most this many bytes per read.
+#define SLOW_READ 4096
+// A player whose connection failed or broke tries again after this long.
+#define RETRY_US 1000000
+// The loops look at the stop flag at least this often.
+#define STOP_CHECK_MS 100
+// Only the first word of a line is looked at, the longest one the server sends has 7 letters.
+#define WORD_MAX 8
+// Two PUT lines.
+#define PUTS_MAX 64
+
+// Latency buckets: one per microsecond below 32 µs, then 32 per power of two, so a percentile is
+// within about 3 percent.
+#define HIST_SUB_BITS 5
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+} LatencyHistogram;
+
+typedef enum {
+    BN_CONNECTS,
+    BN_CONNECT_ERRORS,
+    // Connections closed by the server other than after SCORING.
+    BN_DISCONNECTS,
+    // PUTs that did not fit the socket buffer at once, the player reconnects.
+    BN_WRITE_ERRORS,
+    BN_COEFFS,
+    BN_GAMES,
+    BN_PUTS,
+    BN_BAD_PUTS,
+    // Pairs of PUTs sent together, the second one is early.
+    BN_EARLY_PUTS,
+    BN_STATES,
+    BN_BAD_PUT_ANSWERS,
+    BN_PENALTIES,
+    // Lines the player did not expect at that moment.
+    BN_UNEXPECTED,
+    BN_COUNTERS
+} BenchCounter;
+
+static const char *counter_names[BN_COUNTERS] = {
+    [BN_CONNECTS] = "connects",
+    [BN_CONNECT_ERRORS] = "connect_errors",
+    [BN_DISCONNECTS] = "disconnects",
+    [BN_WRITE_ERRORS] = "write_errors",
+    [BN_COEFFS] = "coeffs",
+    [BN_GAMES] = "games",
+    [BN_PUTS] = "puts",
+    [BN_BAD_PUTS] = "bad_puts",
+    [BN_EARLY_PUTS] = "early_puts",
+    [BN_STATES] = "states",
+    [BN_BAD_PUT_ANSWERS] = "bad_put_answers",
+    [BN_PENALTIES] = "penalties",
+    [BN_UNEXPECTED] = "unexpected",
+};
+
+typedef struct {
+    uint64_t counters[BN_COUNTERS];
+    // From connect() until the connection is established.
+    LatencyHistogram connect;
+    // From HELLO until COEFF.
+    LatencyHistogram coeff_wait;
+    // From PUT until its STATE, less the player's delay; slow readers are kept apart.
+    LatencyHistogram state;
+    LatencyHistogram slow_state;
+} BenchStats;
+
+typedef enum {
+    PL_IDLE,
+    PL_CONNECTING,
+    // HELLO sent, waiting for COEFF.
+    PL_WAITING,
+    PL_PLAYING
+} PlayerPhase;
+
+typedef struct {
+    int fd;
+    PlayerPhase phase;
+    bool slow;
+    size_t timer;
+    // When to connect or to send the next PUT, 0 while waiting for the server.
+    uint64_t next_us;
+    // When a slow reader reads next.
+    uint64_t read_us;
+    uint64_t connect_us;
+    uint64_t hello_us;
+    uint64_t put_us;
+    size_t states_due;
+    size_t bad_puts_due;
+    size_t penalties_due;
+    // The line being read: its first word, then only the spaces are counted.
+    char word[WORD_MAX];
+    size_t word_len;
+    bool in_rest;
+    size_t spaces;
+    char id[32];
+} Player;
+
+// One thread with its own epoll instance and its share of the players.
+typedef struct {
+    pthread_t thread;
+    int epoll_fd;
+    Player *players;
+    size_t count;
+    TimerHeap timers;
+    uint64_t rng;
+    // K, learned from the first STATE. Until then every PUT goes to point 0.
+    size_t k;
+    BenchStats stats;
+    char buf[READ_SIZE];
+} Bench;
+
+static bench_params params;
+static struct sockaddr_storage server;
+static socklen_t server_len;
+static uint64_t delay_us;
+static uint64_t start_us;
+static uint64_t end_us;
+static atomic_bool stop = false;
+
+static void catch_int(int sig) {
+    (void)sig;
+    atomic_store(&stop, true);
+}
+
+static size_t bucket_of(uint64_t us) {
+    if (us < (1u << HIST_SUB_BITS)) {
+        return us;
+    }
+    unsigned msb = 63 - __builtin_clzll(us);
+    return ((size_t)(msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) +
+           ((us >> (msb - HIST_SUB_BITS)) & ((1u << HIST_SUB_BITS) - 1));
+}
+
+static uint64_t bucket_start(size_t b) {
+    if (b < (1u << HIST_SUB_BITS)) {
+        return b;
+    }
+    unsigned msb = (b >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    return ((uint64_t)(1u << HIST_SUB_BITS) | (b & ((1u << HIST_SUB_BITS) - 1))) << (msb - HIST_SUB_BITS);
+}
+
+static void record(LatencyHistogram *h, uint64_t us) {
+    h->counts[bucket_of(us)]++;
+    h->count++;
+    h->sum += us;
+    if (us > h->max) {
+        h->max = us;
+    }
+}
+
+static void merge(LatencyHistogram *dst, const LatencyHistogram *src) {
+    for (size_t b = 0; b < HIST_BUCKETS; b++) {
+        dst->counts[b] += src->counts[b];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+// The end of the bucket holding the given fraction of the values, never above the largest one.
+static uint64_t percentile(const LatencyHistogram *h, double q) {
+    uint64_t rank = (uint64_t)(q * h->count);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen > rank) {
+            uint64_t end = b + 1 < HIST_BUCKETS ? bucket_start(b + 1) - 1 : h->max;
+            return end < h->max ? end : h->max;
+        }
+    }
+    return h->max;
+}
+
+// xorshift64, one generator per thread.
+static uint64_t next_random(Bench *b) {
+    b->rng ^= b->rng << 13;
+    b->rng ^= b->rng >> 7;
+    b->rng ^= b->rng << 17;
+    return b->rng;
+}
+
+static void count(Bench *b, BenchCounter c) {
+    b->stats.counters[c]++;
+}
+
+static void reschedule(Bench *b, Player *p) {
+    uint64_t at = p->next_us;
+    if (p->slow && p->phase >= PL_WAITING && (at == 0 || p->read_us < at)) {
+        at = p->read_us;
+    }
+    if (at == 0) {
+        thCancel(&b->timers, &p->timer);
+    }
+    else {
+        thSchedule(&b->timers, p - b->players, &p->timer, at);
+    }
+}
+
+// Closes the connection, the player connects again right away after a game and later after a
+// failure. Answers still due are forgotten.
+static void close_player(Bench *b, Player *p, uint64_t now, bool failed) {
+    if (p->fd >= 0) {
+        close(p->fd);
+        p->fd = -1;
+    }
+    p->phase = PL_IDLE;
+    p->next_us = failed ? now + RETRY_US : now;
+    p->states_due = 0;
+    p->bad_puts_due = 0;
+    p->penalties_due = 0;
+    p->word_len = 0;
+    p->in_rest = false;
+    p->spaces = 0;
+    reschedule(b, p);
+}
+
+static void start_connect(Bench *b, Player *p, uint64_t now) {
+    p->fd = socket(server.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (p->fd < 0) {
+        count(b, BN_CONNECT_ERRORS);
+        close_player(b, p, now, true);
+        return;
+    }
+    int one = 1;
+    setsockopt(p->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+    p->connect_us = now;
+    if (connect(p->fd, (struct sockaddr *) &server, server_len) < 0 && errno != EINPROGRESS) {
+        count(b, BN_CONNECT_ERRORS);
+        close_player(b, p, now, true);
+        return;
+    }
+    struct epoll_event ev = {.events = EPOLLOUT, .data.u64 = p - b->players};
+    if (epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, p->fd, &ev) < 0) {
+        syserr("epoll_ctl");
+    }
+    p->phase = PL_CONNECTING;
+}
+
+static bool send_line(Bench *b, Player *p, const char *line, size_t len, uint64_t now) {
+    if (send(p->fd, line, len, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)len) {
+        count(b, BN_WRITE_ERRORS);
+        close_player(b, p, now, true);
+        return false;
+    }
+    return true;
+}
+
+static void connected(Bench *b, Player *p, uint64_t now) {
+    int err = 0;
+    socklen_t len = sizeof err;
+    if (getsockopt(p->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        count(b, BN_CONNECT_ERRORS);
+        close_player(b, p, now, true);
+        return;
+    }
+    count(b, BN_CONNECTS);
+    record(&b->stats.connect, now - p->connect_us);
+
+    char hello[64];
+    int hello_len = snprintf(hello, sizeof hello, "HELLO %s\r\n", p->id);
+    if (!send_line(b, p, hello, hello_len, now)) {
+        return;
+    }
+    p->hello_us = now;
+    p->phase = PL_WAITING;
+
+    // A slow reader is left to its timer.
+    struct epoll_event ev = {.events = p->slow ? 0 : EPOLLIN, .data.u64 = p - b->players};
+    if (epoll_ctl(b->epoll_fd, EPOLL_CTL_MOD, p->fd, &ev) < 0) {
+        syserr("epoll_ctl");
+    }
+    if (p->slow) {
+        p->read_us = now + params.slow_ms * 1000;
+        reschedule(b, p);
+    }
+}
+
+// One exchange: a PUT with a bad value, a valid one, or two valid ones of which the second is early.
+static bool send_puts(Bench *b, Player *p, uint64_t now) {
+    char line[PUTS_MAX];
+    size_t len;
+    uint64_t kind = next_random(b) % 100;
+    size_t point = b->k == SIZE_MAX ? 0 : next_random(b) % (b->k + 1);
+    int value = (int)(next_random(b) % 11) - 5;
+
+    if (kind < params.bad_percent) {
+        len = snprintf(line, sizeof line, "PUT %zu 9\r\n", point);
+        p->bad_puts_due++;
+        count(b, BN_BAD_PUTS);
+    }
+    else {
+        len = snprintf(line, sizeof line, "PUT %zu %d\r\n", point, value);
+        p->states_due++;
+        count(b, BN_PUTS);
+        if (kind < params.bad_percent + params.early_percent) {
+            len += snprintf(line + len, sizeof line - len, "PUT %zu %d\r\n", point, -value);
+            p->states_due++;
+            p->penalties_due++;
+            count(b, BN_PUTS);
+            count(b, BN_EARLY_PUTS);
+        }
+    }
+    p->put_us = now;
+    return send_line(b, p, line, len, now);
+}
+
+static bool word_is(const Player *p, const char *word) {
+    size_t len = strlen(word);
+    return p->word_len == len && memcmp(p->word, word, len) == 0;
+}
+
+// Counts an answer the player waited for, or an unexpected line.
+static bool answered(Bench *b, size_t *due, BenchCounter counter) {
+    if (*due == 0) {
+        count(b, BN_UNEXPECTED);
+        return false;
+    }
+    (*due)--;
+    count(b, counter);
+    return true;
+}
+
+// Returns false once the player closed the connection.
+static bool process_line(Bench *b, Player *p, uint64_t now) {
+    if (word_is(p, "STATE")) {
+        if (b->k == SIZE_MAX) {
+            b->k = p->spaces;
+        }
+        if (answered(b, &p->states_due, BN_STATES)) {
+            uint64_t expected = p->put_us + delay_us;
+            record(p->slow ? &b->stats.slow_state : &b->stats.state, now > expected ? now - expected : 0);
+        }
+    }
+    else if (word_is(p, "BAD_PUT")) {
+        answered(b, &p->bad_puts_due, BN_BAD_PUT_ANSWERS);
+    }
+    else if (word_is(p, "PENALTY")) {
+        answered(b, &p->penalties_due, BN_PENALTIES);
+    }
+    else if (word_is(p, "COEFF") && p->phase == PL_WAITING) {
+        count(b, BN_COEFFS);
+        record(&b->stats.coeff_wait, now - p->hello_us);
+        p->phase = PL_PLAYING;
+        p->next_us = now;
+    }
+    else if (word_is(p, "SCORING")) {
+        count(b, BN_GAMES);
+        close_player(b, p, now, false);
+        return false;
+    }
+    else {
+        count(b, BN_UNEXPECTED);
+    }
+
+    // A PENALTY goes out before the STATE it comes with and is not waited for.
+    if (p->phase == PL_PLAYING && p->next_us == 0 && p->states_due == 0 && p->bad_puts_due == 0) {
+        uint64_t next = params.put_rate ? p->put_us + 1000000 / params.put_rate : now;
+        p->next_us = next > now ? next : now;
+    }
+    return true;
+}
+
+// Reads what the socket holds, at most SLOW_READ bytes for a slow reader. Returns false once the
+// connection is closed.
+static bool read_player(Bench *b, Player *p, uint64_t now) {
+    ssize_t n = recv(p->fd, b->buf, p->slow ? SLOW_READ : READ_SIZE, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return true;
+    }
+    if (n <= 0) {
+        count(b, BN_DISCONNECTS);
+        close_player(b, p, now, true);
+        return false;
+    }
+
+    for (ssize_t i = 0; i < n; i++) {
+        char ch = b->buf[i];
+        if (ch == '\n') {
+            if (!process_line(b, p, now)) {
+                return false;
+            }
+            p->word_len = 0;
+            p->in_rest = false;
+            p->spaces = 0;
+        }
+        else if (!p->in_rest) {
+            if (ch == ' ') {
+                p->in_rest = true;
+            }
+            else if (ch != '\r' && p->word_len < WORD_MAX) {
+                p->word[p->word_len++] = ch;
+            }
+        }
+        else if (b->k == SIZE_MAX) {
+            p->spaces += ch == ' ';
+        }
+        else {
+            // The rest of a STATE line is of no interest once K is known.
+            const char *nl = memchr(b->buf + i, '\n', n - i);
+            if (!nl) {
+                break;
+            }
+            i = nl - b->buf - 1;
+        }
+    }
+    return true;
+}
+
+static void on_timer(Bench *b, Player *p, uint64_t now) {
+    if (p->slow && p->phase >= PL_WAITING && p->read_us <= now) {
+        p->read_us = now + params.slow_ms * 1000;
+        if (!read_player(b, p, now)) {
+            return;
+        }
+    }
+    if (p->next_us != 0 && p->next_us <= now) {
+        p->next_us = 0;
+        if (p->phase == PL_IDLE) {
+            start_connect(b, p, now);
+        }
+        else if (p->phase == PL_PLAYING && !send_puts(b, p, now)) {
+            return;
+        }
+    }
+    reschedule(b, p);
+}
+
+static void on_event(Bench *b, Player *p, uint64_t now) {
+    if (p->phase == PL_CONNECTING) {
+        connected(b, p, now);
+        return;
+    }
+    if (!read_player(b, p, now)) {
+        return;
+    }
+    // An answer may have made the next PUT due.
+    if (p->phase == PL_PLAYING && p->next_us != 0 && p->next_us <= now) {
+        p->next_us = 0;
+        if (!send_puts(b, p, now)) {
+            return;
+        }
+    }
+    reschedule(b, p);
+}
+
+static void *bench_loop(void *arg) {
+    Bench *b = arg;
+    struct epoll_event events[EPOLL_BATCH];
+
+    while (!atomic_load(&stop)) {
+        uint64_t now = now_us();
+        if (now >= end_us) {
+            break;
+        }
+        while (!thEmpty(&b->timers) && thPeek(&b->timers)->deadline <= now) {
+            Player *p = &b->players[thPeek(&b->timers)->handle];
+            thPop(&b->timers);
+            on_timer(b, p, now_us());
+        }
+
+        uint64_t until = end_us;
+        if (!thEmpty(&b->timers) && thPeek(&b->timers)->deadline < until) {
+            until = thPeek(&b->timers)->deadline;
+        }
+        uint64_t timeout = until > now ? (until - now + 999) / 1000 : 0;
+        int n = epoll_wait(b->epoll_fd, events, EPOLL_BATCH,
+                           timeout < STOP_CHECK_MS ? (int)timeout : STOP_CHECK_MS);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            syserr("epoll_wait");
+        }
+        // A clock reading costs little next to the read, and a whole batch can take a while.
+        for (int i = 0; i < n; i++) {
+            on_event(b, &b->players[events[i].data.u64], now_us());
+        }
+    }
+    return NULL;
+}
+
+static void bench_init(Bench *b, size_t index) {
+    b->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (b->epoll_fd < 0) {
+        syserr("epoll_create1");
+    }
+    thInit(&b->timers);
+    b->rng = 0x9e3779b97f4a7c15ull * (index + 1);
+    b->k = SIZE_MAX;
+
+    // Player g of all goes to thread g % threads, so a connect rate spreads over the threads.
+    b->count = (params.players - index + params.threads - 1) / params.threads;
+    b->players = calloc(b->count, sizeof *b->players);
+    if (!b->players) fatal("Out of memory");
+    for (size_t j = 0; j < b->count; j++) {
+        Player *p = &b->players[j];
+        size_t g = index + j * params.threads;
+        p->fd = -1;
+        p->timer = TIMER_NONE;
+        p->slow = next_random(b) % 100 < params.slow_percent;
+        int len = snprintf(p->id, sizeof p->id, "B%zu", g);
+        memset(p->id + len, 'x', params.lowercase);
+        p->id[len + params.lowercase] = '\0';
+        p->next_us = start_us + (params.connect_rate ? g * 1000000 / params.connect_rate : 0);
+        reschedule(b, p);
+    }
+}
+
+static void bench_destroy(Bench *b) {
+    for (size_t j = 0; j < b->count; j++) {
+        if (b->players[j].fd >= 0) {
+            close(b->players[j].fd);
+        }
+    }
+    thDestroy(&b->timers);
+    free(b->players);
+    close(b->epoll_fd);
+}
+
+static void print_histogram(const char *name, const LatencyHistogram *h) {
+    printf(",\"%s\":{\"count\":%" PRIu64 ",\"mean\":%" PRIu64 ",\"p50\":%" PRIu64 ",\"p90\":%" PRIu64
+           ",\"p99\":%" PRIu64 ",\"p999\":%" PRIu64 ",\"max\":%" PRIu64 "}",
+           name, h->count, h->count ? h->sum / h->count : 0, percentile(h, 0.5), percentile(h, 0.9),
+           percentile(h, 0.99), percentile(h, 0.999), h->max);
+}
+
+// One JSON object on stdout, latencies in microseconds.
+static void print_report(const BenchStats *st, double seconds) {
+    const uint64_t *c = st->counters;
+    printf("{\"players\":%zu,\"threads\":%zu,\"seconds\":%.3f", params.players, params.threads, seconds);
+    for (size_t i = 0; i < BN_COUNTERS; i++) {
+        printf(",\"%s\":%" PRIu64, counter_names[i], c[i]);
+    }
+    printf(",\"connect_rate\":%.1f,\"put_rate\":%.1f,\"state_rate\":%.1f",
+           c[BN_CONNECTS] / seconds, (c[BN_PUTS] + c[BN_BAD_PUTS]) / seconds, c[BN_STATES] / seconds);
+    print_histogram("connect_us", &st->connect);
+    print_histogram("coeff_wait_us", &st->coeff_wait);
+    print_histogram("state_latency_us", &st->state);
+    print_histogram("slow_state_latency_us", &st->slow_state);
+    printf("}\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    read_params_bench(argc, argv, &params);
+    if (params.threads > params.players) {
+        params.threads = params.players;
+    }
+    raise_fd_limit(params.players + 64);
+    install_signal_handler(SIGINT, catch_int, 0);
+
+    if (params.ipv4) {
+        struct sockaddr_in addr = get_server_addr_ipv4(params.server_addr, params.port);
+        memcpy(&server, &addr, sizeof addr);
+        server_len = sizeof addr;
+    }
+    else {
+        struct sockaddr_in6 addr = get_server_addr_ipv6(params.server_addr, params.port);
+        memcpy(&server, &addr, sizeof addr);
+        server_len = sizeof addr;
+    }
+    delay_us = params.lowercase * 1000000;
+
+    start_us = now_us();
+    end_us = start_us + params.seconds * 1000000;
+    Bench *benches = calloc(params.threads, sizeof *benches);
+    if (!benches) fatal("Out of memory");
+    for (size_t i = 0; i < params.threads; i++) {
+        bench_init(&benches[i], i);
+    }
+
+    // The main thread runs the first loop itself.
+    for (size_t i = 1; i < params.threads; i++) {
+        errno = pthread_create(&benches[i].thread, NULL, bench_loop, &benches[i]);
+        if (errno != 0) {
+            syserr("pthread_create");
+        }
+    }
+    bench_loop(&benches[0]);
+    for (size_t i = 1; i < params.threads; i++) {
+        pthread_join(benches[i].thread, NULL);
+    }
+    uint64_t stopped = now_us();
+
+    BenchStats *total = &benches[0].stats;
+    for (size_t i = 1; i < params.threads; i++) {
+        const BenchStats *st = &benches[i].stats;
+        for (size_t c = 0; c < BN_COUNTERS; c++) {
+            total->counters[c] += st->counters[c];
+        }
+        merge(&total->connect, &st->connect);
+        merge(&total->coeff_wait, &st->coeff_wait);
+        merge(&total->state, &st->state);
+        merge(&total->slow_state, &st->slow_state);
+    }
+    print_report(total, (stopped - start_us) / 1e6);
+
+    for (size_t i = 0; i < params.threads; i++) {
+        bench_destroy(&benches[i]);
+    }
+    free(benches);
+    return 0;
+}
@@ -19,9 +19,14 @@
 #include "messages.h"
 #include "cb.h"
 #include "queue.h"
+#include "fixed.h"
+#include "wire.h"
+#include "poly.h"
 
 #define POLL_TIMEOUT 1000
 #define MAX_PUT_SIZE 23
+// COEFF frames carry n + 1 doubles, this bounds n far above anything sensible.
+#define MAX_FRAME_SIZE (64u << 20)
 
 static client_params params;
 static bool finish = false;
@@ -29,41 +34,198 @@ static bool received_response = false;
 static bool received_coeffs = false;
 static double *coeffs = NULL;
 static size_t coeff_count = 0;
+// f(0..f_size - 1). The client does not know K, the table grows as the strategy moves on.
+static double *f_table = NULL;
+static size_t f_size = 0;
 static size_t current_point = 0;
 static double current_value = 0;
+// The last STATE, rebuilt from delta and sparse frames in binary mode.
+static double *state = NULL;
+static size_t state_count = 0;
 
 void process_input(CircularBuffer *input_messages, EventQueue *q) {
-    char *line = NULL;
-    size_t cap  = 0;
+    char *line;
     size_t len;
 
-    while (get_line(input_messages, "\n", 1, &line, &cap, &len)) {
+    while ((line = cbTakeLine(input_messages, "\n", 1, &len))) {
 
-        char* point, *value;
-        if (!is_valid_put(line, len, &point, &value)) {
+        char *point_str, *value_str;
+        double point, value;
+        if (!is_valid_put(line, len, &point_str, &value_str, &point, &value)) {
             error("invalid input line %.*s", (int)len, line);
         }
+        else if (params.binary) {
+            if (point < 0 || point > UINT32_MAX || point != (double)(uint32_t)point) {
+                error("point %s does not fit a PUT frame", point_str);
+                continue;
+            }
+            queue_point_frame(q, now_ms(), false, FRAME_PUT, (uint32_t)point, value);
+        }
         else {
-            char * msg = create_put_msg(point, value);
-            eqPush(q, now_ms(), msg, false);
-            free(msg); 
+            queue_msg(q, now_ms(), false, "PUT %s %s\r\n", point_str, value_str);
+        }
+    }
+}
+
+// SCORING payload: a count, then an id length, the id and the score for every player.
+static void print_scoring_frame(const char *payload, size_t len) {
+    if (len < 4) {
+        error_msg((char*)params.server_addr, "server", params.port, "short SCORING frame");
+        return;
+    }
+    uint32_t count = get_u32le(payload);
+    size_t pos = 4;
+
+    printf("Game end, scoring:");
+    for (uint32_t i = 0; i < count && pos + 4 <= len; i++) {
+        uint32_t id_len = get_u32le(payload + pos);
+        pos += 4;
+        if (id_len > len - pos || len - pos - id_len < 8) {
+            break;
+        }
+        char score[FIXED7_MAX];
+        format_fixed7(score, get_f64le(payload + pos + id_len));
+        printf(" %.*s %s", (int)id_len, payload + pos, score);
+        pos += id_len + 8;
+    }
+    printf(".\n");
+}
+
+// Applies a STATE, STATE_DELTA or STATE_SPARSE frame to state, returns false when it is malformed.
+static bool apply_state_frame(uint8_t type, const char *payload, size_t len) {
+    if (type == FRAME_STATE) {
+        if (len < 4 || get_u32le(payload) != (len - 4) / 8 || (len - 4) % 8 != 0) {
+            return false;
+        }
+        size_t count = get_u32le(payload);
+        if (count != state_count) {
+            double *tmp = realloc(state, (count ? count : 1) * sizeof *state);
+            if (!tmp) fatal("Out of memory");
+            state = tmp;
+            state_count = count;
+        }
+        for (size_t i = 0; i < count; i++) {
+            state[i] = get_f64le(payload + 4 + i * 8);
+        }
+        return true;
+    }
+
+    if (len < FRAME_PAIRS) {
+        return false;
+    }
+    size_t count = get_u32le(payload);
+    size_t pairs = get_u32le(payload + 4);
+    if (pairs != (len - FRAME_PAIRS) / FRAME_POINT_VALUE || (len - FRAME_PAIRS) % FRAME_POINT_VALUE != 0) {
+        return false;
+    }
+    if (type == FRAME_STATE_DELTA && count != state_count) {
+        return false;
+    }
+    const char *p = payload + FRAME_PAIRS;
+    for (size_t i = 0; i < pairs; i++) {
+        if (get_u32le(p + i * FRAME_POINT_VALUE) >= count) {
+            return false;
         }
     }
-    free(line);
+
+    if (type == FRAME_STATE_SPARSE) {
+        double *tmp = realloc(state, (count ? count : 1) * sizeof *state);
+        if (!tmp) fatal("Out of memory");
+        state = tmp;
+        state_count = count;
+        memset(state, 0, count * sizeof *state);
+    }
+    for (size_t i = 0; i < pairs; i++, p += FRAME_POINT_VALUE) {
+        state[get_u32le(p)] = get_f64le(p + 4);
+    }
+    return true;
+}
+
+static void print_state(void) {
+    char value[FIXED7_MAX];
+    printf("Received state");
+    for (size_t i = 0; i < state_count; i++) {
+        format_fixed7(value, state[i]);
+        printf(" %s", value);
+    }
+    printf(".\n");
+}
+
+static void process_server_frames(CircularBuffer *server_messages) {
+    uint8_t type;
+    size_t len;
+    const char *payload;
+    int ret = 0;
+
+    while (!finish &&
+           (ret = get_frame(server_messages, MAX_FRAME_SIZE, &type, &payload, &len)) > 0) {
+        bool values = len >= 4 && (len - 4) % 8 == 0;
+        bool point_value = len == FRAME_POINT_VALUE;
+
+        if (!received_coeffs) {
+            if (type == FRAME_COEFF && values) {
+                size_t count = get_u32le(payload);
+                if (count != (len - 4) / 8) {
+                    error_msg((char*)params.server_addr, "server", params.port, "bad COEFF frame");
+                    continue;
+                }
+                coeffs = malloc((count ? count : 1) * sizeof *coeffs);
+                if (!coeffs) fatal("Out of memory");
+                for (size_t i = 0; i < count; i++) {
+                    coeffs[i] = get_f64le(payload + 4 + i * 8);
+                }
+                coeff_count = count;
+
+                char *text = format_values(payload + 4, count);
+                printf("Received coefficients %s\n", text);
+                free(text);
+                received_response = true;
+                received_coeffs = true;
+            }
+            else {
+                error_msg((char*)params.server_addr, "server", params.port, (char*)frame_name(type));
+            }
+        }
+        else if (type == FRAME_STATE || type == FRAME_STATE_DELTA || type == FRAME_STATE_SPARSE) {
+            if (!apply_state_frame(type, payload, len)) {
+                error_msg((char*)params.server_addr, "server", params.port, (char*)frame_name(type));
+                continue;
+            }
+            print_state();
+            received_response = true;
+        }
+        else if (type == FRAME_SCORING) {
+            print_scoring_frame(payload, len);
+            finish = true;
+        }
+        else if ((type == FRAME_BAD_PUT || type == FRAME_PENALTY) && point_value) {
+            char value[FIXED7_MAX];
+            format_fixed7(value, get_f64le(payload + 4));
+            printf("Received %s %" PRIu32 " %s.\n", frame_name(type), get_u32le(payload), value);
+        }
+        else {
+            error_msg((char*)params.server_addr, "server", params.port, (char*)frame_name(type));
+        }
+    }
+
+    if (ret < 0) {
+        fatal("oversized frame from the server");
+    }
 }
 
 void process_server_message(CircularBuffer *server_messages) {
+    if (params.binary) {
+        process_server_frames(server_messages);
+        return;
+    }
+
     size_t len;
-    size_t cap = 0;
-    char *line = NULL;
+    char *line;
 
-    while (get_line(server_messages, "\r\n", 2, &line, &cap, &len) && !finish) {
+    while ((line = cbTakeLine(server_messages, "\r\n", 2, &len)) && !finish) {
         if (!received_coeffs) {
-            if (strncmp(line, "COEFF ", 6) == 0 && is_valid_state_coeff(line + 6)) {
-                char *payload = line + 6;
-                
+            if (strncmp(line, "COEFF ", 6) == 0 && (coeffs = read_coeffs(line + 6, &coeff_count))) {
                 printf("Received coefficients %s\n", line + 6);
-                coeffs = read_coeffs(payload, &coeff_count);
                 received_response = true;
                 received_coeffs = true;
             }
@@ -91,19 +253,47 @@ void process_server_message(CircularBuffer *server_messages) {
             }
         }
     }
-    free(line); 
+}
+
+static double f_at(size_t x) {
+    if (x >= f_size) {
+        size_t size = f_size ? f_size : 64;
+        while (size <= x) {
+            size *= 2;
+        }
+        double *tmp = realloc(f_table, size * sizeof *tmp);
+        if (!tmp) fatal("Out of memory");
+        pfFill(coeffs, coeff_count, tmp + f_size, f_size, size);
+        f_table = tmp;
+        f_size = size;
+    }
+    return f_table[x];
 }
 
 void send_next(EventQueue *q) {
-    double sc = calculate_f(coeff_count, coeffs, current_point);
+    double sc = f_at(current_point);
     sc -= current_value;
     while (sc == 0) {
         current_value = 0;
         current_point++;
-        sc = calculate_f(coeff_count, coeffs, current_point);
+        sc = f_at(current_point);
+    }
+
+    if (params.binary) {
+        double value = sc >= 5 ? 5 : sc <= -5 ? -5 : sc;
+        queue_point_frame(q, now_ms(), false, FRAME_PUT, (uint32_t)current_point, value);
+        if (value == sc) {
+            current_point++;
+            current_value = 0;
+        }
+        else {
+            current_value += value;
+        }
+        received_response = false;
+        return;
     }
 
-    char *msg = malloc(MAX_PUT_SIZE);
+    char msg[MAX_PUT_SIZE];
 
     if (sc >= 5) {
         snprintf(msg, MAX_PUT_SIZE, "PUT %zu 5\r\n", current_point);
@@ -114,14 +304,16 @@ void send_next(EventQueue *q) {
         current_value -= 5;
     }
     else {
-        snprintf(msg, MAX_PUT_SIZE, "PUT %zu %.7f\r\n", current_point, sc);
+        // |sc| < 5 here, so the value takes at most 10 characters.
+        char value[FIXED7_MAX];
+        format_fixed7(value, sc);
+        snprintf(msg, MAX_PUT_SIZE, "PUT %zu %.10s\r\n", current_point, value);
         current_point++;
         current_value = 0;
     }
     
-    eqPush(q, now_ms(), msg, false);
+    eqPushInline(q, now_ms(), msg, strlen(msg), false);
     received_response = false;
-    free(msg);
 }
 
 void clean_up(EventQueue *q, struct pollfd *fds) {
@@ -200,7 +392,8 @@ int main(int argc, char *argv[]) {
         fds[1].events = 0;
     }
 
-    if(send_hello(params.id, &messages_to_send, socket_fd) < 0) {
+    if(send_hello(params.id, params.delta ? HELLO_DELTA : params.binary ? HELLO_BINARY : NULL,
+                  &messages_to_send, socket_fd) < 0) {
         fatal("can't send hello");
     }
 
@@ -256,7 +449,10 @@ int main(int argc, char *argv[]) {
     cbDestroy(&input_messages);
     cbDestroy(&server_messages);
     eqDestroy(&messages_to_send);
+    mbCacheFlush();
     close(socket_fd);
     free(coeffs);
+    free(f_table);
+    free(state);
     return 0;
 }
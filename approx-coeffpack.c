@@ -0,0 +1,130 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "err.h"
+#include "messages.h"
+#include "pack.h"
+#include "wire.h"
+
+// Records are built in memory and written after the index, whose size is known only at the end.
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+} Bytes;
+
+static char *grow(Bytes *b, size_t n) {
+    if (b->len + n > b->capacity) {
+        size_t new_cap = b->capacity ? b->capacity : 4096;
+        while (b->len + n > new_cap) {
+            new_cap *= 2;
+        }
+        char *tmp = realloc(b->data, new_cap);
+        if (!tmp) fatal("Out of memory");
+        b->data = tmp;
+        b->capacity = new_cap;
+    }
+    char *p = b->data + b->len;
+    b->len += n;
+    return p;
+}
+
+// Appends the frame and text of one line, the line is checked the way the client checks COEFF.
+static void add_record(Bytes *records, Bytes *index, char *line, size_t len, size_t line_no) {
+    // Without the "\n" and a "\r" before it.
+    size_t end = len - 1;
+    if (end > 0 && line[end - 1] == '\r') {
+        end--;
+    }
+    size_t count;
+    double *coeffs = NULL;
+    if (end > 6 && strncmp(line, "COEFF ", 6) == 0) {
+        char term = line[end];
+        line[end] = '\0';
+        coeffs = read_coeffs(line + 6, &count);
+        line[end] = term;
+    }
+    if (!coeffs || count > UINT32_MAX || len > UINT32_MAX) {
+        fatal("Line %zu is not a valid COEFF line", line_no);
+    }
+
+    char *e = grow(index, PACK_ENTRY);
+    put_u64le(e, records->len);
+    put_u32le(e + 8, (uint32_t)count);
+    put_u32le(e + 12, (uint32_t)len);
+
+    size_t frame_len = pkFrameLen(count);
+    char *p = grow(records, frame_len + len + 1);
+    put_frame_header(p, FRAME_COEFF, (uint32_t)(frame_len - FRAME_HEADER));
+    put_u32le(p + FRAME_HEADER, (uint32_t)count);
+    for (size_t i = 0; i < count; i++) {
+        put_f64le(p + FRAME_HEADER + 4 + i * 8, coeffs[i]);
+    }
+    memcpy(p + frame_len, line, len);
+    p[frame_len + len] = '\0';
+    free(coeffs);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fatal("Usage: %s coefficients.txt coefficients.pack", argv[0]);
+    }
+
+    FILE *in = fopen(argv[1], "r");
+    if (!in) {
+        syserr("fopen %s", argv[1]);
+    }
+
+    Bytes index = {0}, records = {0};
+    char *line = NULL;
+    size_t cap = 0;
+    size_t count = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, in)) > 0) {
+        // The server never hands out a line still being written, the pack does not hold one either.
+        if (line[len - 1] != '\n') {
+            error("Skipping the incomplete last line");
+            break;
+        }
+        add_record(&records, &index, line, (size_t)len, ++count);
+    }
+    if (ferror(in)) {
+        fatal("error while reading file");
+    }
+    if (count > UINT32_MAX) {
+        fatal("Too many lines");
+    }
+    free(line);
+    fclose(in);
+
+    // Record offsets were relative to the first record.
+    size_t first = PACK_HEADER + index.len;
+    for (size_t i = 0; i < count; i++) {
+        char *e = index.data + i * PACK_ENTRY;
+        put_u64le(e, get_u64le(e) + first);
+    }
+    char header[PACK_HEADER];
+    memcpy(header, PACK_MAGIC, PACK_MAGIC_LEN);
+    put_u32le(header + PACK_MAGIC_LEN, (uint32_t)count);
+    put_u32le(header + PACK_MAGIC_LEN + 4, 0);
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        syserr("fopen %s", argv[2]);
+    }
+    if (fwrite(header, 1, sizeof header, out) != sizeof header ||
+        fwrite(index.data, 1, index.len, out) != index.len ||
+        fwrite(records.data, 1, records.len, out) != records.len ||
+        fclose(out) != 0) {
+        syserr("write %s", argv[2]);
+    }
+    printf("Packed %zu lines into %s (%zu bytes).\n", count, argv[2], first + records.len);
+
+    free(index.data);
+    free(records.data);
+    return 0;
+}
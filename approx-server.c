@@ -1,17 +1,21 @@
+#define _GNU_SOURCE
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <endian.h>
 #include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <arpa/inet.h>
-#include <poll.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "err.h"
 #include "common.h"
@@ -19,234 +23,888 @@
 #include "queue.h"
 #include "cb.h"
 #include "client.h"
+#include "uring.h"
+#include "table.h"
+#include "timers.h"
+#include "wire.h"
+#include "fixed.h"
+#include "feeder.h"
+#include "poly.h"
+#include "put.h"
+#include "status.h"
+#include "metrics.h"
+#include "logger.h"
 
-#define CONNECTIONS 1024
 #define TIMEOUT 1000
+#define MAX_EVENTS 64
 
-static bool finish = false;
-static bool finish_game = false;
+// epoll tags of the listening sockets and the wake-up eventfd, clients are tagged with their handle.
+#define TAG_IPV4 1
+#define TAG_IPV6 2
+#define TAG_WAKE 3
+
+// Input buffers that grew past this are given back once drained.
+#define IN_KEEP 16384
+
+#define UR_ENTRIES 4096
+#define UR_BUFFERS 1024
+#define UR_BUFFER_SIZE 16384
+
+// io_uring requests carry their context pointer with the operation in the low bits.
+#define OP_RECV 1
+#define OP_SEND 2
+#define OP_CANCEL 3
+#define OP_MASK 3
+
+// In-flight io_uring requests reference this context, so it outlives its client until they complete.
+typedef struct uring_conn {
+    client_handle handle;
+    bool closed;
+    bool send_inflight;
+    unsigned inflight;
+
+    // The kernel reads these until the send completes.
+    struct iovec iov[SEND_IOV_MAX];
+    struct msghdr msg;
+    // Queue of a client that went away during a send, the iovecs may point into its events.
+    EventQueue orphan;
+    bool has_orphan;
+    // At the end of a game: SCORING, still to be queued behind the ready events, and the socket,
+    // which stays open until they are out.
+    MsgBuf *last;
+    int fd;
+} uring_conn;
+
+// One event loop with its own listeners and its own slice of clients.
+typedef struct {
+    size_t id;
+    pthread_t thread;
+    int epoll_fd;
+    int wake_fd;
+    int listeners[2];
+    bool use_uring;
+    Uring ring;
+    size_t io_contexts;
+
+    ClientTable table;
+    TimerHeap timers;
+
+    // Clients whose HELLO waits for a COEFF line, in the order they sent it.
+    client_handle *parked;
+    size_t parked_count;
+    size_t parked_capacity;
+    // Parked clients that ended since, their handles are dropped once they are half of the list.
+    size_t parked_gone;
+
+    // The worker's players for the status endpoint, rows are only added while it is served.
+    StatusBoard board;
+    // Players waiting for a COEFF line as of the last loop iteration.
+    atomic_size_t status_waiting;
+    // NULL unless the status endpoint serves /metrics.
+    Metrics *metrics;
+} worker_t;
+
+static atomic_bool finish = false;
+static atomic_bool finish_game = false;
+static atomic_size_t connected_clients = 0;
+// Input buffered and output queued by all clients, and how often their limits were enforced.
+static atomic_size_t buffered_in = 0;
+static atomic_size_t queued_out = 0;
+static atomic_size_t budget_disconnects = 0;
+static atomic_size_t budget_throttles = 0;
 static server_params params;
-static size_t received_puts = 0;
-static int active_clients = 0;
+// The PUT counter is the game's, shared by all workers.
+static PutGame game;
+static CoeffFeeder feeder;
+
+static worker_t *workers;
+static size_t worker_count;
+
+// State of the end-of-game rendezvous of all workers.
+static pthread_mutex_t sync_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sync_cond = PTHREAD_COND_INITIALIZER;
+static size_t sync_arrived = 0;
+static size_t sync_generation = 0;
+// Built once per game, every worker sends the same buffers.
+static MsgBuf *scoring_msg = NULL;
+static MsgBuf *scoring_frame = NULL;
+
+static atomic_size_t games_played = 0;
+static StatusServer status;
+
+static void epoll_update(worker_t *w, int op, int fd, uint32_t events, uint64_t tag) {
+    struct epoll_event ev = { .events = events, .data.u64 = tag };
+    if (epoll_ctl(w->epoll_fd, op, fd, &ev) < 0) {
+        syserr("epoll_ctl");
+    }
+}
+
+// Interrupts epoll_wait of every worker. Only async-signal-safe calls are used here.
+static void wake_all(void) {
+    uint64_t one = 1;
+    for (size_t i = 0; i < worker_count; i++) {
+        ssize_t r = write(workers[i].wake_fd, &one, sizeof one);
+        (void)r;
+    }
+}
+
+// Blocks until every worker has arrived, the last one runs on_last before the others are released.
+// Returns false when the server is shutting down and not every worker will arrive.
+static bool rendezvous(void (*on_last)(void)) {
+    pthread_mutex_lock(&sync_lock);
+    size_t generation = sync_generation;
+    if (++sync_arrived == worker_count) {
+        on_last();
+        sync_arrived = 0;
+        sync_generation++;
+        pthread_cond_broadcast(&sync_cond);
+        pthread_mutex_unlock(&sync_lock);
+        return true;
+    }
+    while (generation == sync_generation && !atomic_load(&finish)) {
+        pthread_cond_wait(&sync_cond, &sync_lock);
+    }
+    bool done = (generation != sync_generation);
+    if (!done) {
+        sync_arrived--;
+    }
+    pthread_mutex_unlock(&sync_lock);
+    return done;
+}
+
+// Releases workers waiting in rendezvous() once the server is shutting down.
+static void release_rendezvous(void) {
+    pthread_mutex_lock(&sync_lock);
+    pthread_cond_broadcast(&sync_cond);
+    pthread_mutex_unlock(&sync_lock);
+}
+
+// EPOLLOUT is armed only while the client has due data that could not be written.
+static void set_out_interest(worker_t *w, client_t *c, bool want) {
+    if (c->out_armed == want) {
+        return;
+    }
+    uint32_t events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    if (want) {
+        events |= EPOLLOUT;
+    }
+    epoll_update(w, EPOLL_CTL_MOD, c->fd, events, c->handle);
+    c->out_armed = want;
+}
+
+static void uring_start(worker_t *w, client_t *c) {
+    c->io = calloc(1, sizeof *c->io);
+    if (!c->io) fatal("Out of memory");
+    c->io->handle = c->handle;
+    c->io->fd = -1;
+    w->io_contexts++;
+
+    urPrepRecvMultishot(urGetSqe(&w->ring), c->fd, (uint64_t)(uintptr_t)c->io | OP_RECV);
+    c->io->inflight++;
+}
+
+static void uring_send_last(worker_t *w, uring_conn *io);
+
+// The client is gone, its context is released once the kernel has no request referencing it.
+// With SCORING left to send, the context takes over the socket and closes it afterwards.
+static void uring_stop(worker_t *w, client_t *c) {
+    uring_conn *io = c->io;
+    io->closed = true;
+    if (io->send_inflight || io->last) {
+        io->orphan = c->q;
+        io->has_orphan = true;
+        eqInit(&c->q);
+    }
+    if (io->last) {
+        io->fd = c->fd;
+        c->fd = -1;
+        // Like a full socket under epoll, a client that does not read gets no more.
+        if (io->send_inflight) {
+            urPrepCancel(urGetSqe(&w->ring), (uint64_t)(uintptr_t)io | OP_SEND,
+                         (uint64_t)(uintptr_t)io | OP_CANCEL);
+            io->inflight++;
+        }
+        else {
+            uring_send_last(w, io);
+        }
+    }
+    else {
+        // Ends the multishot recv, which would otherwise keep the socket open.
+        shutdown(c->fd, SHUT_RDWR);
+    }
+    if (io->inflight == 0) {
+        free(io);
+        w->io_contexts--;
+    }
+    c->io = NULL;
+}
 
 // Find slot for a new client.
-int find_slot(struct pollfd *fds, client_t *clients, int client_fd, struct sockaddr* addr) {
-    if (fcntl(client_fd, F_SETFL, O_NONBLOCK)) {
+int find_slot(worker_t *w, int client_fd, struct sockaddr* addr) {
+    // Only the epoll backend reads and writes the socket itself, io_uring requests wait for it in
+    // the kernel and its sockets are left as accepted.
+    if (!w->use_uring && fcntl(client_fd, F_SETFL, O_NONBLOCK)) {
         syserr("fcntl");
     }
 
-    if (active_clients + 2 < CONNECTIONS) {
-        size_t idx = active_clients;
-        fds[idx+2].fd = client_fd;
-        fds[idx+2].events = POLLIN;
+    // The limit is shared by all shards.
+    if (atomic_fetch_add(&connected_clients, 1) >= params.max_clients) {
+        atomic_fetch_sub(&connected_clients, 1);
+        return false;
+    }
 
-        clientInit(&clients[idx], params.n, params.k);
-        client_t *c = &clients[idx];
+    client_handle handle = ctAdd(&w->table);
+    client_t *c = ctGet(&w->table, handle);
+    clientInit(c, client_fd, params.n, params.k);
+    c->handle = handle;
+    if (w->use_uring) {
+        uring_start(w, c);
+    }
+    else {
+        epoll_update(w, EPOLL_CTL_ADD, client_fd, EPOLLIN | EPOLLRDHUP | EPOLLET, handle);
+    }
 
-        if (addr->sa_family == AF_INET) {
-            struct sockaddr_in *a4 = (struct sockaddr_in*)addr;
-            inet_ntop(AF_INET, &a4->sin_addr, c->ipstr, sizeof c->ipstr);
-            c->port = ntohs(a4->sin_port);
-        } else {
-            struct sockaddr_in6 *a6 = (struct sockaddr_in6*)addr;
-            inet_ntop(AF_INET6, &a6->sin6_addr, c->ipstr, sizeof c->ipstr);
-            c->port = ntohs(a6->sin6_port);
+    if (addr->sa_family == AF_INET) {
+        struct sockaddr_in *a4 = (struct sockaddr_in*)addr;
+        inet_ntop(AF_INET, &a4->sin_addr, c->ipstr, sizeof c->ipstr);
+        c->port = ntohs(a4->sin_port);
+    } else {
+        struct sockaddr_in6 *a6 = (struct sockaddr_in6*)addr;
+        inet_ntop(AF_INET6, &a6->sin6_addr, c->ipstr, sizeof c->ipstr);
+        c->port = ntohs(a6->sin6_port);
+    }
+    lgWrite(LG_INFO, "New client [%s]:%hu\n", c->ipstr, c->port);
+    thSchedule(&w->timers, handle, &c->timer_pos, c->hello_deadline);
+    return true;
+}
+
+// Pending events or completions of the client see a stale handle afterwards and are ignored.
+void end_connection(worker_t *w, client_t *c) {
+    // The row points to the player's id, it goes first.
+    if (c->status_row != SIZE_MAX) {
+        client_handle moved;
+        if (stBoardRemove(&w->board, c->status_row, &moved)) {
+            ctGet(&w->table, moved)->status_row = c->status_row;
         }
-        printf("New client [%s]:%hu\n", c->ipstr, c->port);
-        active_clients++;
-        return true; 
     }
-    return false;
+    if (c->received_hello && !c->send_coeffs) {
+        w->parked_gone++;
+    }
+    atomic_fetch_sub(&game.puts, c->put_send);
+    atomic_fetch_sub(&buffered_in, c->in_counted);
+    atomic_fetch_sub(&queued_out, c->out_counted);
+    thCancel(&w->timers, &c->timer_pos);
+    if (c->io) {
+        uring_stop(w, c);
+    }
+    if (c->fd >= 0) {
+        close(c->fd);
+    }
+    clientDestroy(c);
+    ctRemove(&w->table, c->handle);
+    atomic_fetch_sub(&connected_clients, 1);
+    MT_COUNT(closed, 1);
 }
 
-void end_connection(client_t *clients, struct pollfd *pfd, int id) {
-    int last = active_clients - 1;
-    if (id != last) {
+static void uring_submit_send(worker_t *w, uring_conn *io, int fd, size_t count, int flags) {
+    io->msg = (struct msghdr) { .msg_iov = io->iov, .msg_iovlen = count };
+    urPrepSendmsg(urGetSqe(&w->ring), fd, &io->msg, flags, (uint64_t)(uintptr_t)io | OP_SEND);
+    io->send_inflight = true;
+    io->inflight++;
+}
 
-        client_t tmp = clients[id];
-        clients[id] = clients[last];
-        clients[last] = tmp;
-        
-        struct pollfd tmpf = pfd[id + 2];
-        pfd[id + 2] = pfd[last + 2];
-        pfd[last + 2] = tmpf;
+// With io_uring at most one send per client is in flight, the next one is queued on its completion.
+static void uring_send(worker_t *w, client_t *c) {
+    uring_conn *io = c->io;
+    if (io->send_inflight) {
+        return;
     }
+    size_t count = gather_data_to_send(&c->q, io->iov, SEND_IOV_MAX);
+    if (count == 0) {
+        return;
+    }
+    uring_submit_send(w, io, c->fd, count, 0);
+}
 
-    received_puts -= clients[last].put_send;
-    clientDestroy(&clients[last]);
-    close(pfd[last + 2].fd);
-    pfd[last + 2].fd= -1;
+// Sends what a finished client has left once no send of it is in flight: the rest of the ready
+// events, then SCORING, without waiting for a full socket, as end_game does under epoll. Nothing
+// else of its queue goes out. The socket is closed once they are sent or cannot be.
+static void uring_send_last(worker_t *w, uring_conn *io) {
+    if (io->last) {
+        // Nothing queued is due as early, it lines up right behind the ready events. Collecting
+        // earlier could move the inline events the send in flight reads.
+        eqPush(&io->orphan, 0, io->last, false);
+        eqCollectDue(&io->orphan, 0);
+        io->last = NULL;
+    }
+    size_t count = eqReadyIov(&io->orphan, io->iov, SEND_IOV_MAX);
+    if (count > 0) {
+        uring_submit_send(w, io, io->fd, count, MSG_DONTWAIT);
+        return;
+    }
+    // Ends the multishot recv as well.
+    shutdown(io->fd, SHUT_RDWR);
+    close(io->fd);
+    io->fd = -1;
+}
 
-    active_clients--;
+// The client's next deadline is its HELLO timeout or the send time of its next message.
+// A client waiting for the socket needs no timer, the socket wakes it up.
+static void update_timer(worker_t *w, client_t *c) {
+    bool blocked = w->use_uring ? c->io->send_inflight : !c->writable;
+    uint64_t deadline;
+    if (!c->received_hello) {
+        deadline = c->hello_deadline;
+    }
+    else if (!eqEmpty(&c->q) && !blocked) {
+        deadline = eqPeek(&c->q)->send_time;
+    }
+    else {
+        thCancel(&w->timers, &c->timer_pos);
+        return;
+    }
+    thSchedule(&w->timers, c->handle, &c->timer_pos, deadline);
 }
 
-void end_game(struct pollfd *fds, client_t* clients){
-    client_t *ptrs[active_clients];
-    size_t  ptrs_count = 0;
+// Write everything that is due, arm EPOLLOUT if the socket could not take it all.
+// Returns false when the connection had to be closed.
+static bool flush_client(worker_t *w, client_t *c) {
+    if (w->use_uring) {
+        uring_send(w, c);
+        update_timer(w, c);
+        return true;
+    }
+    if (!c->writable) {
+        update_timer(w, c);
+        return true;
+    }
 
-    for (int i = 0; i < active_clients; i++) {
-        client_t *c = &clients[i];
-        ptrs[ptrs_count++] = c;
+    ssize_t send = process_data_to_send(&c->q, c->fd, c->player_id);
+    if (send == -1) {
+        error("write");
+        end_connection(w, c);
+        return false;
+    }
+    if (send == 1) {
+        set_out_interest(w, c, false);
     }
-    char* msg = create_scoring_msg(ptrs, ptrs_count, params.n, params.k);
-    for (int i = active_clients - 1; i >= 0; i--) {
+    else {
+        c->writable = false;
+        set_out_interest(w, c, true);
+    }
+    update_timer(w, c);
+    return true;
+}
 
-        write(fds[i + 2].fd, msg, strlen(msg));
-        end_connection(clients, fds, i);
+// Brings the server-wide totals up to date with the client's buffers.
+static void count_buffers(client_t *c, size_t *total_in, size_t *total_out) {
+    size_t in = c->in_buf.size;
+    size_t out = eqBytes(&c->q);
+    // The differences may wrap around, the sums stay correct modulo SIZE_MAX + 1.
+    *total_in = atomic_fetch_add(&buffered_in, in - c->in_counted) + (in - c->in_counted);
+    *total_out = atomic_fetch_add(&queued_out, out - c->out_counted) + (out - c->out_counted);
+    c->in_counted = in;
+    c->out_counted = out;
+}
+
+// Past a total limit only the clients holding more than their share of it are at fault.
+static bool over_limit(size_t own, size_t limit, size_t total, size_t total_limit) {
+    if (own > limit) {
+        return true;
     }
-    printf("Game end, scoring: %s.", msg + 8);
-    finish_game = false;
-    free(msg);
-    sleep(1);
+    size_t clients = atomic_load(&connected_clients);
+    return total > total_limit && own > total_limit / (clients ? clients : 1);
 }
 
-void process_put(client_t *c, char* point_str, char* value_str) {
-    double value;
-    size_t point;
-    uint64_t now = now_ms();
+// Input stops being processed once the answers exceed the limit, enforce_budget decides the rest.
+static bool output_full(client_t *c) {
+    return eqBytes(&c->q) > params.out_limit;
+}
 
-    if (!eqLastPutSend(&c->q) || !c->send_coeffs) {
-        char * msg = create_penalty_msg(point_str, value_str);
-        eqPush(&c->q, now, msg, false);
-        free(msg); 
-        c->penalty += 20;
+// Applies the limits once the client's input was processed. Returns false when it was disconnected.
+static bool enforce_budget(worker_t *w, client_t *c) {
+    size_t total_in, total_out;
+    count_buffers(c, &total_in, &total_out);
+    const char *pid = c->player_id ? c->player_id : "UNKNOWN";
+
+    // No valid message is this long, waiting for the rest of it would not help. A throttled epoll
+    // client is not read, what it has buffered are complete messages left for later.
+    bool reading = !c->throttled || w->use_uring;
+    if (reading && over_limit(c->in_counted, params.in_limit, total_in, params.in_total)) {
+        lgWrite(LG_INFO, "ending connection with %s: %zu bytes of input buffered\n", pid, c->in_counted);
+        atomic_fetch_add(&budget_disconnects, 1);
+        end_connection(w, c);
+        return false;
     }
-    if (!valid_point_value(point_str, value_str, &point, &value, params.k)) {
-        char * msg = create_badput_msg(point_str, value_str);
-        eqPush(&c->q, now + 1000, msg, true);
-        free(msg); 
-        c->penalty += 10;
+    if (c->throttled || !over_limit(c->out_counted, params.out_limit, total_out, params.out_total)) {
+        return true;
     }
-    else {
-        c->approx[point] += value;
-        c->put_send++;
-        received_puts++;
+    if (!params.throttle) {
+        lgWrite(LG_INFO, "ending connection with %s: %zu bytes of output queued\n", pid, c->out_counted);
+        atomic_fetch_add(&budget_disconnects, 1);
+        end_connection(w, c);
+        return false;
+    }
+    lgWrite(LG_INFO, "throttling %s: %zu bytes of output queued\n", pid, c->out_counted);
+    atomic_fetch_add(&budget_throttles, 1);
+    c->throttled = true;
+    return true;
+}
+
+static void serve_input(worker_t *w, client_t *c);
+ssize_t process_message(worker_t *w, client_t *c);
 
-        finish_game = (received_puts == params.m);
-        char * msg = create_state_msg(c->approx, params.k);
-        eqPush(&c->q, now + c->delay, msg, true);
-        free(msg); 
+// Brings the player's row on the status board up to date after its PUTs or its COEFF.
+static void update_status(worker_t *w, client_t *c) {
+    if (c->status_row != SIZE_MAX) {
+        stBoardSet(&w->board, c->status_row, c->put_send, c->penalty, clientScore(c));
     }
 }
 
-void read_next_coeffs(client_t *c, FILE *fp) {
-    size_t max_line = 6 + (params.n + 1) * 12 + 3;// tu zrob define
-    char line[max_line];
+// Processes the buffered messages. When the answers filled the queue and sending made room right
+// away, the rest is processed too. Returns false when the client was disconnected.
+static bool handle_input(worker_t *w, client_t *c) {
+    bool stopped;
+    do {
+        if (process_message(w, c) < 0) {
+            lgWrite(LG_INFO, "ending connection with %s\n", c->player_id ? c->player_id : "UNKNOWN");
+            end_connection(w, c);
+            return false;
+        }
+        stopped = output_full(c);
+        if (!flush_client(w, c) || !enforce_budget(w, c)) {
+            return false;
+        }
+    } while (stopped && !c->throttled);
+    update_status(w, c);
+    cbTrim(&c->in_buf, IN_KEEP);
+    return true;
+}
+
+// After sending, a throttled client whose queue drained to half its limit is read again.
+static void release_throttle(worker_t *w, client_t *c) {
+    size_t total_in, total_out;
+    count_buffers(c, &total_in, &total_out);
+    if (!c->throttled || c->out_counted > params.out_limit / 2) {
+        return;
+    }
+    c->throttled = false;
+
+    // Messages left unprocessed go first, with io_uring the recv kept adding to them.
+    if (!handle_input(w, c)) {
+        return;
+    }
+    if (!w->use_uring && !c->throttled) {
+        serve_input(w, c);
+    }
+}
+
+// Runs in the last worker to stop, while every other worker waits, so all shards can be read.
+static void build_scoring(void) {
+    size_t total = 0;
+    for (size_t i = 0; i < worker_count; i++) {
+        total += ctCount(&workers[i].table);
+    }
+
+    client_t **ptrs = malloc((total ? total : 1) * sizeof *ptrs);
+    if (!ptrs) fatal("Out of memory");
+    size_t ptrs_count = 0;
+
+    for (size_t i = 0; i < worker_count; i++) {
+        for (size_t j = 0; j < ctCount(&workers[i].table); j++) {
+            ptrs[ptrs_count++] = ctActive(&workers[i].table, j);
+        }
+    }
+    scoring_msg = create_scoring_msg(ptrs, ptrs_count, false);
+    scoring_frame = create_scoring_msg(ptrs, ptrs_count, true);
+    lgWrite(LG_INFO, "Game end, scoring: %s.", scoring_msg->data + 8);
+    free(ptrs);
+}
+
+static void finish_scoring(void) {
+    mbRelease(scoring_msg);
+    mbRelease(scoring_frame);
+    scoring_msg = NULL;
+    scoring_frame = NULL;
+    atomic_fetch_add(&games_played, 1);
+    atomic_store(&finish_game, false);
+}
+
+// The last PUT of the game stops every worker.
+static void complete_game(void) {
+    atomic_store(&finish_game, true);
+    wake_all();
+}
 
-    // The task mentioned that such a situation would never occur unless something new was written to the file
-    // if my program encounters EOF it means that something new is already in the file so I keep trying to read it.
-    while (!fgets(line, sizeof(line), fp)) {
-        if (feof(fp)) {
-            error("Unexpected EOF while reading COEFF");
-            clearerr(fp);
-            fseek(fp, 0, SEEK_CUR);
-            sleep(1);
+void end_game(worker_t *w){
+    if (!rendezvous(build_scoring)) {
+        return;
+    }
+    while (ctCount(&w->table) > 0) {
+        client_t *c = ctActive(&w->table, ctCount(&w->table) - 1);
+        MsgBuf *scoring = c->binary ? scoring_frame : scoring_msg;
+        if (c->io) {
+            // A send may be in flight, SCORING goes through the ring behind it (uring_stop).
+            c->io->last = mbRef(scoring);
         }
         else {
-            fatal("error while reading file");
+            ssize_t written = send(c->fd, scoring->data, scoring->len, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (written > 0) {
+                MT_COUNT(bytes_out, (size_t)written);
+            }
+            if (written == (ssize_t)scoring->len) {
+                MT_COUNT(sent[MT_SCORING], 1);
+            }
         }
+        end_connection(w, c);
+    }
+    w->parked_count = 0;
+    w->parked_gone = 0;
+    if (!rendezvous(finish_scoring)) {
+        return;
     }
+    sleep(1);
+}
 
-    eqPush(&c->q, now_ms(), line, true);
+// Queues the next COEFF line for c. Returns false when the feeder has none ready yet.
+static bool give_coeffs(client_t *c) {
+    CoeffLine line;
+    if (!cfTake(&feeder, &line, c->coeffs)) {
+        return false;
+    }
+    pfFill(c->coeffs, line.count, c->f, 0, params.k + 1);
+    // PUTs sent before COEFF were counted against f = 0.
+    exact_error(c, params.k);
+
+    // Lines of a pack are sent straight from its mapping.
+    uint64_t now = now_ms();
+    if (c->binary) {
+        mbRelease(line.msg);
+        if (line.frame) {
+            eqPushStatic(&c->q, now, line.frame, line.frame_len, true);
+        }
+        else {
+            eqPush(&c->q, now, create_values_frame(FRAME_COEFF, c->coeffs, line.count), true);
+        }
+    }
+    else if (line.msg) {
+        eqPush(&c->q, now, line.msg, true);
+    }
+    else {
+        eqPushStatic(&c->q, now, line.line, line.line_len, true);
+    }
     // It is not exact moment of sending COEFF, but on our lab it was mentioned that We can mark
     // something as sent when it is being put in the sending buffor.
     c->send_coeffs = true;
+    return true;
+}
+
+// Clients that said HELLO while the feeder had no line wait in order, later ones queue behind them.
+static void park_client(worker_t *w, client_t *c) {
+    if (w->parked_count == w->parked_capacity) {
+        size_t new_cap = w->parked_capacity ? w->parked_capacity * 2 : 16;
+        client_handle *tmp = realloc(w->parked, new_cap * sizeof *tmp);
+        if (!tmp) fatal("Out of memory");
+        w->parked = tmp;
+        w->parked_capacity = new_cap;
+    }
+    w->parked[w->parked_count++] = c->handle;
+    // It may wait long, its input buffer can go meanwhile.
+    cbTrim(&c->in_buf, 0);
+}
+
+// Drops the handles of parked clients that ended, the others keep their order.
+static void drop_gone_parked(worker_t *w) {
+    size_t kept = 0;
+    for (size_t i = 0; i < w->parked_count; i++) {
+        if (ctGet(&w->table, w->parked[i])) {
+            w->parked[kept++] = w->parked[i];
+        }
+    }
+    w->parked_count = kept;
+    w->parked_gone = 0;
+}
+
+// Hands out the lines that became ready since, the feeder wakes the workers when it has one.
+static void serve_parked(worker_t *w) {
+    if (2 * w->parked_gone > w->parked_count) {
+        drop_gone_parked(w);
+    }
+    size_t served = 0;
+    while (served < w->parked_count) {
+        // Clients gone in the meantime only give up their place.
+        client_t *c = ctGet(&w->table, w->parked[served]);
+        if (c && !give_coeffs(c)) {
+            break;
+        }
+        served++;
+        if (c) {
+            update_status(w, c);
+            flush_client(w, c);
+        }
+        else {
+            w->parked_gone--;
+        }
+    }
+    w->parked_count -= served;
+    memmove(w->parked, w->parked + served, w->parked_count * sizeof *w->parked);
+}
+
+// Runs in the status thread. Each worker's board is copied under its own lock, no worker is
+// asked for anything or waited for.
+static void collect_status(GameStatus *st) {
+    stClear(&st->table);
+    st->waiting = 0;
+    for (size_t i = 0; i < worker_count; i++) {
+        stBoardCopy(&st->table, &workers[i].board);
+        st->waiting += atomic_load(&workers[i].status_waiting);
+    }
+    st->game = atomic_load(&games_played) + 1;
+    st->puts = atomic_load(&game.puts);
+    st->m = params.m;
+    st->clients = atomic_load(&connected_clients);
+}
+
+// Runs in the status thread. The workers' counters are added up, the rest is kept by the server
+// anyway.
+static void write_metrics(FILE *out) {
+    Metrics *threads[worker_count];
+    for (size_t i = 0; i < worker_count; i++) {
+        threads[i] = workers[i].metrics;
+    }
+    mtWrite(out, threads, worker_count);
+
+    fprintf(out, "# HELP approx_connected_clients Clients connected now.\n"
+                 "# TYPE approx_connected_clients gauge\napprox_connected_clients %zu\n"
+                 "# HELP approx_game_puts PUTs counted in the current game.\n"
+                 "# TYPE approx_game_puts gauge\napprox_game_puts %zu\n"
+                 "# HELP approx_games_total Games finished.\n"
+                 "# TYPE approx_games_total counter\napprox_games_total %zu\n"
+                 "# HELP approx_budget_disconnects_total Clients disconnected over their buffer limits.\n"
+                 "# TYPE approx_budget_disconnects_total counter\napprox_budget_disconnects_total %zu\n"
+                 "# HELP approx_budget_throttles_total Clients throttled over their output limit.\n"
+                 "# TYPE approx_budget_throttles_total counter\napprox_budget_throttles_total %zu\n",
+            atomic_load(&connected_clients), atomic_load(&game.puts), atomic_load(&games_played),
+            atomic_load(&budget_disconnects), atomic_load(&budget_throttles));
+
+    fprintf(out, "# HELP approx_log_dropped_total Log lines dropped because the log was full.\n"
+                 "# TYPE approx_log_dropped_total counter\n");
+    for (size_t l = 0; l < LG_LEVELS; l++) {
+        fprintf(out, "approx_log_dropped_total{level=\"%s\"} %" PRIu64 "\n", lgLevelName(l), lgDropped(l));
+    }
+}
+
+// After a binary HELLO the client sends nothing but PUT frames.
+static ssize_t process_frames(client_t *c) {
+    uint8_t type;
+    size_t len;
+    const char *payload;
+    int ret = 0;
+
+    while (!atomic_load(&finish_game) && !output_full(c) &&
+           (ret = get_frame(&c->in_buf, FRAME_POINT_VALUE, &type, &payload, &len)) > 0) {
+        if (type == FRAME_PUT && len == FRAME_POINT_VALUE) {
+            uint32_t point = get_u32le(payload);
+            double value = get_f64le(payload + 4);
+            process_put_frame(&game, c, point, value);
+            MT_COUNT(received[MT_PUT], 1);
+
+            if (lgEnabled(LG_DEBUG)) {
+                char value_str[FIXED7_MAX];
+                format_fixed7(value_str, value);
+                lgWrite(LG_DEBUG, "%s puts %s in %" PRIu32 "\n", c->player_id, value_str, point);
+            }
+        }
+        else {
+            char desc[64];
+            snprintf(desc, sizeof desc, "%s frame of %zu bytes", frame_name(type), len);
+            error_msg(c->ipstr, c->player_id, c->port, desc);
+            MT_COUNT(received[MT_INVALID], 1);
+        }
+    }
 
-    size_t idx = 0;
-    char *saveptr = NULL;
-    for (char *tok = strtok_r(line + 6, " \r\n", &saveptr);
-         tok;
-         tok = strtok_r(NULL, " ", &saveptr)) {
-         c->coeffs[idx++] = strtod(tok, NULL);
+    // The stream cannot be resynchronized after a bogus length.
+    if (ret < 0) {
+        error_msg(c->ipstr, c->player_id, c->port, "oversized frame");
+        MT_COUNT(received[MT_INVALID], 1);
+        return -1;
     }
+    return 1;
 }
 
-ssize_t process_message(client_t *c, FILE *fp) {
+ssize_t process_message(worker_t *w, client_t *c) {
     size_t len;
-    size_t cap = 0;
-    char *line = NULL;
+    char *line;
 
-    while (get_line(&c->in_buf, "\r\n", 2, &line, &cap, &len) && !finish_game) {
+    if (c->binary) {
+        return process_frames(c);
+    }
+
+    while (!output_full(c) && (line = cbTakeLine(&c->in_buf, "\r\n", 2, &len)) &&
+           !atomic_load(&finish_game)) {
         if (!c->received_hello) {
+            // "HELLO <id> BIN [DELTA]" asks for binary frames, ids themselves have no spaces.
+            char *suffix = strncmp(line, "HELLO ", 6) == 0 ? strchr(line + 6, ' ') : NULL;
+            if (suffix && strcmp(suffix + 1, HELLO_BINARY) == 0) {
+                *suffix = '\0';
+                c->binary = true;
+                slUseBinary(&c->state);
+            }
+            else if (suffix && strcmp(suffix + 1, HELLO_DELTA) == 0) {
+                *suffix = '\0';
+                c->binary = true;
+                slUseDelta(&c->state);
+            }
+
             if (strncmp(line, "HELLO ", 6) == 0 && is_valid_player_id(line + 6)) {
                 c->player_id = strdup(line + 6);
                 if (!c->player_id) fatal("Out of memory");
                 c->received_hello = true;
+                MT_COUNT(received[MT_HELLO], 1);
+                if (params.status) {
+                    c->status_row = stBoardAdd(&w->board, c->player_id, c->handle);
+                }
 
                 c->delay = count_lowercase(c->player_id) * 1000;
 
-                printf("[%s]:%hu is now known as %s.\n", c->ipstr, c->port, c->player_id);
-                read_next_coeffs(c, fp);
+                lgWrite(LG_INFO, "[%s]:%hu is now known as %s%s.\n", c->ipstr, c->port, c->player_id,
+                        c->state.delta ? " (binary, delta)" : c->binary ? " (binary)" : "");
+                if (w->parked_count > 0 || !give_coeffs(c)) {
+                    // A used up pack gets no more lines, waiting would be forever.
+                    if (cfExhausted(&feeder)) {
+                        lgWrite(LG_INFO, "no COEFF left for %s\n", c->player_id);
+                        return -1;
+                    }
+                    park_client(w, c);
+                }
+                if (c->binary) {
+                    return process_frames(c);
+                }
             }
             else {
                 error_msg(c->ipstr, c->player_id, c->port, line);
+                MT_COUNT(received[MT_INVALID], 1);
                 return -1;
             }
         }
         else {
             char *point_str, *value_str;
-            if (strncmp(line, "PUT ", 4) == 0 && is_valid_put(line + 4,len - 4,&point_str, &value_str)) {
-                process_put(c, point_str, value_str);
-                printf("%s puts %s in %s\n", c->player_id, value_str, point_str);
+            double point, value;
+            if (strncmp(line, "PUT ", 4) == 0 &&
+                is_valid_put(line + 4, len - 4, &point_str, &value_str, &point, &value)) {
+                process_put(&game, c, point_str, value_str, point, value);
+                MT_COUNT(received[MT_PUT], 1);
+                lgWrite(LG_DEBUG, "%s puts %s in %s\n", c->player_id, value_str, point_str);
             }
-            else {             
+            else {
                 error_msg(c->ipstr, c->player_id, c->port, line);
+                MT_COUNT(received[MT_INVALID], 1);
             }
         }
     }
-    free(line);
     return 1;
 }
 
-// This function removes all client who did not send hello and sets POLLOUT event when messages are ready to be sent.
-void clean_up(struct pollfd *fds, client_t* clients) {
+// Removes clients who did not send hello in time and sends messages which became due.
+// Only clients whose deadline expired are touched.
+void run_timers(worker_t *w) {
     uint64_t now = now_ms();
-    for (int i = active_clients - 1; i >= 0; --i) {
+    while (!thEmpty(&w->timers) && thPeek(&w->timers)->deadline <= now) {
+        client_t *c = ctGet(&w->table, thPeek(&w->timers)->handle);
+        thPop(&w->timers);
 
-        client_t *c = &clients[i];
-        if (!c->received_hello && now > c->hello_deadline) {
-            printf("ending connection - no hello (%d)\n",  i);
-            end_connection(clients, fds, i);
+        if (!c->received_hello) {
+            lgWrite(LG_INFO, "ending connection - no hello ([%s]:%hu)\n", c->ipstr, c->port);
+            end_connection(w, c);
             continue;
         }
-
-        if (!eqEmpty(&c->q) && eqPeek(&c->q)->send_time <= now) {
-            fds[i + 2].events = POLLIN | POLLOUT;
-        }
-        else {
-            fds[i + 2].events = POLLIN;
+        if (flush_client(w, c)) {
+            release_throttle(w, c);
         }
     }
 }
 
-void close_all(struct pollfd *fds, client_t* clients) {
-    if (fds[0].fd >= 0) {
-        close(fds[0].fd);
-    }
-    if (fds[1].fd >= 0) {
-        close(fds[1].fd);
+// The loop sleeps until the earliest deadline, but not longer than TIMEOUT.
+static int next_timeout(worker_t *w) {
+    if (thEmpty(&w->timers)) {
+        return TIMEOUT;
     }
-    for (int i = active_clients - 1; i >= 0; --i) {
-        end_connection(clients, fds, i);
+    uint64_t deadline = thPeek(&w->timers)->deadline;
+    uint64_t now = now_ms();
+    if (deadline <= now) {
+        return 0;
     }
+    return deadline - now < TIMEOUT ? (int)(deadline - now) : TIMEOUT;
 }
 
-/* Termination signal handling. */
-static void catch_int() {
-    finish = true;
-}
+static void accept_client(worker_t *w, int listener) {
+    struct sockaddr_storage client_addr;
 
-int main(int argc, char *argv[]) {
+    // Listeners are edge-triggered too, so accept until the backlog is empty.
+    while (true) {
+        int client_fd = accept(listener, (struct sockaddr *) &client_addr,
+                               &((socklen_t) {sizeof client_addr}));
+        if (client_fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE) {
+                error("accept: out of descriptors");
+                return;
+            }
+            syserr("accept");
+        }
 
-    read_params_server(argc, argv, &params);
+        if (!find_slot(w, client_fd, (struct sockaddr *) &client_addr)) {
+            close(client_fd);
+            lgWrite(LG_INFO, "too many clients\n");
+        }
+        else {
+            MT_COUNT(accepted, 1);
+        }
+    }
+}
 
-    FILE *fp = fopen(params.file, "r");
-    if (!fp) {
-        syserr("fopen");
+// Reads until the socket is drained, as required by edge-triggered mode.
+static void serve_input(worker_t *w, client_t *c) {
+    while (!atomic_load(&finish_game)) {
+        ssize_t received_bytes = read_message(&c->in_buf, c->fd);
+        const char *pid = c->player_id ? c->player_id : "UNKNOWN";
+
+        if (received_bytes == -2) {
+            return;
+        }
+        if (received_bytes == -1) {
+            error("error when reading message from %s: %s", pid, strerror(errno));
+            end_connection(w, c);
+            return;
+        } else if (received_bytes == 0) {
+            lgWrite(LG_INFO, "ending connection with %s\n", pid);
+            end_connection(w, c);
+            return;
+        } else {
+            if (!handle_input(w, c)) {
+                return;
+            }
+            // The rest stays in the socket until the queue drains.
+            if (c->throttled) {
+                return;
+            }
+        }
     }
+}
 
-    install_signal_handler(SIGINT, catch_int, SA_RESTART);
+/* Termination signal handling. */
+static void catch_int() {
+    atomic_store(&finish, true);
+    wake_all();
+}
 
+// Binds both listeners of a worker. With several workers every listener shares the port through SO_REUSEPORT.
+static void open_listeners(worker_t *w, uint16_t *port) {
     int socket_ipv4 = socket(AF_INET, SOCK_STREAM, 0);
     if (socket_ipv4 < 0) {
         syserr("cannot create a socket");
@@ -256,12 +914,15 @@ int main(int argc, char *argv[]) {
     struct sockaddr_in server_addr_ipv4;
     server_addr_ipv4.sin_family = AF_INET; // IPv4
     server_addr_ipv4.sin_addr.s_addr = htonl(INADDR_ANY); // Listening on all interfaces.
-    server_addr_ipv4.sin_port = htons(params.port);
+    server_addr_ipv4.sin_port = htons(*port);
 
     int yes = 1;
     if (setsockopt(socket_ipv4, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0) {
         syserr("setsockopt SO_REUSEADDR");
     }
+    if (worker_count > 1 && setsockopt(socket_ipv4, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) < 0) {
+        syserr("setsockopt SO_REUSEPORT");
+    }
 
     if (bind(socket_ipv4, (struct sockaddr *) &server_addr_ipv4, (socklen_t) sizeof server_addr_ipv4) < 0) {
         syserr("bind");
@@ -271,11 +932,20 @@ int main(int argc, char *argv[]) {
         syserr("listen");
     }
 
+    // Port 0 means a random port, the remaining listeners have to join the one that was picked.
+    if (*port == 0) {
+        if (getsockname(socket_ipv4, (struct sockaddr *) &server_addr_ipv4,
+                        &((socklen_t) {sizeof server_addr_ipv4})) < 0) {
+            syserr("getsockname");
+        }
+        *port = ntohs(server_addr_ipv4.sin_port);
+    }
+
     int socket_ipv6 = socket(AF_INET6, SOCK_STREAM, 0);
     if (socket_ipv6 < 0) {
         if (errno == EAFNOSUPPORT) {
             error("not supported protocol ipv6");
-            socket_ipv6 = -1; 
+            socket_ipv6 = -1;
         }
         else {
             syserr("cannot create a socket");
@@ -291,8 +961,12 @@ int main(int argc, char *argv[]) {
         if (setsockopt(socket_ipv6, SOL_SOCKET, SO_REUSEADDR, &yes6, sizeof(yes6)) < 0) {
             syserr("setsockopt SO_REUSEADDR (IPv6)");
         }
+        if (worker_count > 1 && setsockopt(socket_ipv6, SOL_SOCKET, SO_REUSEPORT, &yes6, sizeof(yes6)) < 0) {
+            syserr("setsockopt SO_REUSEPORT (IPv6)");
+        }
 
         struct sockaddr_in6 server_addr_ipv6;
+        memset(&server_addr_ipv6, 0, sizeof server_addr_ipv6);
         server_addr_ipv6.sin6_family = AF_INET6;  // IPv6
         server_addr_ipv6.sin6_addr = in6addr_any; // Listening on all interfaces.
         server_addr_ipv6.sin6_port = server_addr_ipv4.sin_port;
@@ -308,111 +982,410 @@ int main(int argc, char *argv[]) {
 
     }
 
-    client_t clients[CONNECTIONS - 2];
+    if (fcntl(socket_ipv4, F_SETFL, O_NONBLOCK) ||
+        (socket_ipv6 >= 0 && fcntl(socket_ipv6, F_SETFL, O_NONBLOCK))) {
+        syserr("fcntl");
+    }
+
+    w->listeners[0] = socket_ipv4;
+    w->listeners[1] = socket_ipv6;
+}
+
+// Every client needs a descriptor, so the soft limit is raised as far as the configured maximum needs.
+static void worker_init(worker_t *w, size_t id, uint16_t *port) {
+    w->id = id;
+    if (params.status) {
+        w->metrics = aligned_alloc(alignof(Metrics), sizeof *w->metrics);
+        if (!w->metrics) fatal("Out of memory");
+        memset(w->metrics, 0, sizeof *w->metrics);
+    }
+    ctInit(&w->table);
+    thInit(&w->timers);
+    stBoardInit(&w->board);
+
+    w->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (w->wake_fd < 0) {
+        syserr("eventfd");
+    }
+
+    open_listeners(w, port);
+
+    w->use_uring = params.uring;
+    if (w->use_uring && !urInit(&w->ring, UR_ENTRIES, UR_BUFFERS, UR_BUFFER_SIZE)) {
+        error("io_uring is not available, falling back to epoll");
+        w->use_uring = false;
+    }
+    if (w->use_uring) {
+        urPrepPollMultishot(urGetSqe(&w->ring), w->wake_fd, TAG_WAKE);
+        urPrepPollMultishot(urGetSqe(&w->ring), w->listeners[0], TAG_IPV4);
+        if (w->listeners[1] >= 0) {
+            urPrepPollMultishot(urGetSqe(&w->ring), w->listeners[1], TAG_IPV6);
+        }
+        return;
+    }
+
+    w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (w->epoll_fd < 0) {
+        syserr("epoll_create1");
+    }
+
+    epoll_update(w, EPOLL_CTL_ADD, w->wake_fd, EPOLLIN, TAG_WAKE);
+    epoll_update(w, EPOLL_CTL_ADD, w->listeners[0], EPOLLIN | EPOLLET, TAG_IPV4);
+    if (w->listeners[1] >= 0) {
+        epoll_update(w, EPOLL_CTL_ADD, w->listeners[1], EPOLLIN | EPOLLET, TAG_IPV6);
+    }
+}
+
+static void uring_recv_done(worker_t *w, uring_conn *io, struct io_uring_cqe *cqe) {
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+    client_t *c = io->closed ? NULL : ctGet(&w->table, io->handle);
+
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        bool stored = true;
+        if (c && cqe->res > 0) {
+            stored = cbPushBack(&c->in_buf, urBuffer(&w->ring, bid), (size_t)cqe->res);
+            MT_COUNT(bytes_in, (size_t)cqe->res);
+        }
+        urRecycleBuffer(&w->ring, bid);
+        if (!stored) {
+            // Only this client goes, the others keep playing.
+            error("no memory for the input of %s", c->player_id ? c->player_id : "UNKNOWN");
+            end_connection(w, c);
+            return;
+        }
+    }
+    if (!c) {
+        return;
+    }
 
-    struct pollfd poll_descriptors[CONNECTIONS];
+    const char *pid = c->player_id ? c->player_id : "UNKNOWN";
+    if (cqe->res == 0) {
+        lgWrite(LG_INFO, "ending connection with %s\n", pid);
+        end_connection(w, c);
+        return;
+    }
+    if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+        error("error when reading message from %s", pid);
+        end_connection(w, c);
+        return;
+    }
+    if (cqe->res > 0) {
+        // A throttled client's input waits, only the limits are checked.
+        if (c->throttled ? !enforce_budget(w, c) : !handle_input(w, c)) {
+            return;
+        }
+    }
+    // The request stops when it runs out of provided buffers, they are recycled right away.
+    if (!more) {
+        urPrepRecvMultishot(urGetSqe(&w->ring), c->fd, (uint64_t)(uintptr_t)io | OP_RECV);
+        io->inflight++;
+    }
+}
 
-    // The main socket has index 0 and 1.
-    poll_descriptors[0].fd = socket_ipv4;
-    poll_descriptors[0].events = POLLIN;
+// Once SCORING could not be sent, the rest goes unsent too.
+static void uring_drop_last(uring_conn *io) {
+    if (io->last) {
+        mbRelease(io->last);
+        io->last = NULL;
+    }
+    while (io->orphan.ready_count > 0) {
+        eqPop(&io->orphan);
+    }
+}
 
-    poll_descriptors[1].fd = socket_ipv6;
-    if (socket_ipv6 >= 0) {
-        poll_descriptors[1].events = POLLIN;
+static void uring_send_done(worker_t *w, uring_conn *io, struct io_uring_cqe *cqe) {
+    io->send_inflight = false;
+    if (io->closed) {
+        // A finished client, a cancelled send wrote nothing.
+        if (io->fd >= 0) {
+            if (cqe->res >= 0) {
+                data_sent(&io->orphan, (size_t)cqe->res, "finished client");
+            }
+            else if (cqe->res != -ECANCELED) {
+                uring_drop_last(io);
+            }
+            uring_send_last(w, io);
+        }
+        return;
     }
-    else {
-        poll_descriptors[1].events = 0;
+    client_t *c = ctGet(&w->table, io->handle);
+    if (cqe->res < 0) {
+        error("write");
+        end_connection(w, c);
+        return;
+    }
+    data_sent(&c->q, (size_t)cqe->res, c->player_id);
+    if (flush_client(w, c)) {
+        release_throttle(w, c);
+    }
+}
+
+static void uring_completion(worker_t *w, struct io_uring_cqe *cqe) {
+    uint64_t tag = cqe->user_data;
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+
+    if (tag == TAG_WAKE || tag == TAG_IPV4 || tag == TAG_IPV6) {
+        int fd = tag == TAG_WAKE ? w->wake_fd : w->listeners[tag - TAG_IPV4];
+        if (tag == TAG_WAKE) {
+            uint64_t count;
+            ssize_t r = read(w->wake_fd, &count, sizeof count);
+            (void)r;
+        }
+        else if (!atomic_load(&finish)) {
+            accept_client(w, fd);
+        }
+        if (!more) {
+            urPrepPollMultishot(urGetSqe(&w->ring), fd, tag);
+        }
+        return;
+    }
+
+    uring_conn *io = (uring_conn *)(uintptr_t)(tag & ~(uint64_t)OP_MASK);
+    if (!more) {
+        io->inflight--;
+    }
+    // Pinned while handled, ending the connection must not free the context under us.
+    io->inflight++;
+    if ((tag & OP_MASK) == OP_RECV) {
+        uring_recv_done(w, io, cqe);
+    }
+    else if ((tag & OP_MASK) == OP_SEND) {
+        uring_send_done(w, io, cqe);
+    }
+    io->inflight--;
+    if (io->closed && io->inflight == 0) {
+        if (io->has_orphan) {
+            eqDestroy(&io->orphan);
+        }
+        free(io);
+        w->io_contexts--;
     }
+}
+
+// Handles every completion that is ready, returns how many there were.
+static size_t uring_reap(worker_t *w) {
+    size_t count = 0;
+    struct io_uring_cqe *cqe;
+    while (!atomic_load(&finish_game) && (cqe = urPeekCqe(&w->ring))) {
+        struct io_uring_cqe copy = *cqe;
+        urCqeSeen(&w->ring);
+        uring_completion(w, &copy);
+        count++;
+    }
+    return count;
+}
+
+// Counts the wake-up, returns when the iteration's work started if it is measured.
+static uint64_t loop_woke(worker_t *w) {
+    if (!w->metrics) {
+        return 0;
+    }
+    mtAdd(&w->metrics->wakeups, 1);
+    return mtClock(w->metrics);
+}
 
-    for (int i = 2; i < CONNECTIONS; ++i) {
-        poll_descriptors[i].fd = -1;
+static void loop_done(worker_t *w, uint64_t busy_from) {
+    if (w->metrics) {
+        mtObserve(&w->metrics->loop, now_us() - busy_from);
     }
+}
+
+// Submissions of the whole turn and the wait for completions share one io_uring_enter.
+static void uring_loop(worker_t *w) {
+    do {
+        if (urSubmitAndWait(&w->ring, 1, next_timeout(w)) < 0) {
+            syserr("io_uring_enter");
+        }
+        uint64_t busy_from = loop_woke(w);
+
+        uring_reap(w);
+        if (atomic_load(&finish_game)) {
+            end_game(w);
+        }
+        if (w->parked_count > 0) {
+            serve_parked(w);
+        }
+        run_timers(w);
+        atomic_store(&w->status_waiting, w->parked_count - w->parked_gone);
+        loop_done(w, busy_from);
+
+    } while (!atomic_load(&finish));
+}
+
+static void *worker_loop(void *arg) {
+    worker_t *w = arg;
+    struct epoll_event events[MAX_EVENTS];
+    mtLocal = w->metrics;
 
-    struct sockaddr_in client_addr_ipv4;
-    struct sockaddr_in6 client_addr_ipv6;
+    if (w->use_uring) {
+        uring_loop(w);
+        release_rendezvous();
+        mbCacheFlush();
+        return NULL;
+    }
 
     // Main loop.
     do {
-        int poll_status = poll(poll_descriptors, active_clients + 2, TIMEOUT);
-        if (poll_status == -1 ) {
+        int ready = epoll_wait(w->epoll_fd, events, MAX_EVENTS, next_timeout(w));
+        if (ready == -1 ) {
             if (errno == EINTR) {
                 continue;
             }
             else {
-                syserr("poll");
+                syserr("epoll_wait");
             }
         }
-        else if (poll_status > 0) {
-            if (!finish && (poll_descriptors[0].revents & POLLIN)) {
-                // New connection: new client is accepted.
-                int client_fd = accept(poll_descriptors[0].fd,
-                                       (struct sockaddr *) &client_addr_ipv4,
-                                       &((socklen_t) {sizeof client_addr_ipv4}));
-                if (client_fd < 0) {
-                    syserr("accept");
-                }
+        uint64_t busy_from = loop_woke(w);
 
-                if (!find_slot(poll_descriptors, clients, client_fd, (struct sockaddr *) &client_addr_ipv4)) {
-                    close(client_fd);
-                    printf("too many clients\n");
+        for (int e = 0; e < ready; e++) {
+            uint64_t tag = events[e].data.u64;
+            uint32_t revents = events[e].events;
+
+            if (tag == TAG_WAKE) {
+                uint64_t count;
+                ssize_t r = read(w->wake_fd, &count, sizeof count);
+                (void)r;
+                continue;
+            }
+            if (tag == TAG_IPV4 || tag == TAG_IPV6) {
+                // New connection: new client is accepted.
+                if (!atomic_load(&finish)) {
+                    accept_client(w, w->listeners[tag - TAG_IPV4]);
                 }
+                continue;
             }
-            if (!finish && (poll_descriptors[1].revents & POLLIN)) {
-                int client_fd = accept(poll_descriptors[1].fd,
-                    (struct sockaddr *) &client_addr_ipv6,
-                    &((socklen_t) {sizeof client_addr_ipv6}));
 
-                if (client_fd < 0) {
-                    syserr("accept");
+            // Serve data connections.
+            client_t *c = ctGet(&w->table, tag);
+            if (!c) {
+                continue;
+            }
+            if (revents & EPOLLOUT) {
+                c->writable = true;
+                if (!flush_client(w, c)) {
+                    continue;
                 }
-
-                if (!find_slot(poll_descriptors, clients, client_fd, (struct sockaddr *) &client_addr_ipv6)) {
-                    close(client_fd);
-                    printf("too many clients\n");
+                bool was_throttled = c->throttled;
+                release_throttle(w, c);
+                if (was_throttled) {
+                    continue;
                 }
             }
-            // Serve data connections.
+            if ((revents & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) && !c->throttled) {
+                serve_input(w, c);
+            }
+            if (atomic_load(&finish_game)) {
+                break;
+            }
+        }
+        // Another shard may have completed the game, every shard takes part in the scoring.
+        if (atomic_load(&finish_game)) {
+            end_game(w);
+        }
+        if (w->parked_count > 0) {
+            serve_parked(w);
+        }
+        run_timers(w);
+        atomic_store(&w->status_waiting, w->parked_count - w->parked_gone);
+        loop_done(w, busy_from);
 
-            for (int i = active_clients + 1; i >= 2; --i) {
+    } while (!atomic_load(&finish));
 
-                if ((poll_descriptors[i].revents & POLLOUT)) {
-                    ssize_t send = process_data_to_send(&clients[i-2].q, poll_descriptors[i].fd, clients[i-2].player_id);
-                    if (send == -1) {
-                        error("write");
-                        end_connection(clients, poll_descriptors, i - 2);
-                    }
-                }
-                if ((poll_descriptors[i].revents & (POLLIN | POLLERR))) {
-                    
-
-                    ssize_t received_bytes = read_message(&clients[i - 2].in_buf, poll_descriptors[i].fd);
-                    const char *pid = clients[i -2].player_id ? clients[i -2].player_id  : "UNKNOWN";
-
-                    if (received_bytes == -1) {
-                        error("error when reading message from %s", pid);
-                        end_connection(clients, poll_descriptors, i - 2);
-                    } else if (received_bytes == 0) {
-                        printf("ending connection with %s\n", pid);
-                        end_connection(clients, poll_descriptors, i - 2);
-                    } else if (received_bytes > 0) {
-                        if (process_message(&clients[i - 2], fp) < 0) {
-                            end_connection(clients, poll_descriptors, i - 2);
-                            printf("ending connection with %s\n", pid);
-                        }
-                    }
-                }
-                if (finish_game) {
-                    end_game(poll_descriptors, clients);
-                    break;
-                }
+    release_rendezvous();
+    mbCacheFlush();
+    return NULL;
+}
+
+void close_all(worker_t *w) {
+    if (w->listeners[0] >= 0) {
+        close(w->listeners[0]);
+    }
+    if (w->listeners[1] >= 0) {
+        close(w->listeners[1]);
+    }
+    while (ctCount(&w->table) > 0) {
+        end_connection(w, ctActive(&w->table, ctCount(&w->table) - 1));
+    }
+    if (w->use_uring) {
+        // Requests of the closed connections still reference their contexts.
+        while (w->io_contexts > 0) {
+            if (urSubmitAndWait(&w->ring, 1, TIMEOUT) < 0 || uring_reap(w) == 0) {
+                break;
             }
         }
-        clean_up(poll_descriptors, clients);
+        urDestroy(&w->ring);
+    }
+    else {
+        close(w->epoll_fd);
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    read_params_server(argc, argv, &params);
+    game.k = params.k;
+    game.m = params.m;
+    game.on_complete = complete_game;
+    lgStart(params.log_level);
+
+    raise_fd_limit(params.max_clients + 64);
+
+    worker_count = params.threads;
+    workers = calloc(worker_count, sizeof *workers);
+    if (!workers) fatal("Out of memory");
+
+    uint16_t port = params.port;
+    for (size_t i = 0; i < worker_count; i++) {
+        worker_init(&workers[i], i, &port);
+    }
+
+    install_signal_handler(SIGINT, catch_int, SA_RESTART);
+    // Started once the workers have their eventfds, it wakes them when a line is ready.
+    cfStart(&feeder, params.file, params.n, wake_all);
+    if (params.status) {
+        stStart(&status, params.status, collect_status, write_metrics);
+    }
+
+    // The main thread runs the first worker itself.
+    for (size_t i = 1; i < worker_count; i++) {
+        errno = pthread_create(&workers[i].thread, NULL, worker_loop, &workers[i]);
+        if (errno != 0) {
+            syserr("pthread_create");
+        }
+    }
+    worker_loop(&workers[0]);
+
+    for (size_t i = 1; i < worker_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    // It may still be copying the workers' boards.
+    if (params.status) {
+        stStop(&status);
+    }
+    for (size_t i = 0; i < worker_count; i++) {
+        close_all(&workers[i]);
+        close(workers[i].wake_fd);
+        ctDestroy(&workers[i].table);
+        thDestroy(&workers[i].timers);
+        free(workers[i].parked);
+        stBoardFree(&workers[i].board);
+        free(workers[i].metrics);
+    }
+    cfStop(&feeder);
+    free(workers);
+    mbCacheFlush();
 
-    } while (!finish);
+    if (budget_disconnects > 0 || budget_throttles > 0) {
+        lgWrite(LG_INFO, "Over their limits: %zu clients disconnected, %zu throttled.\n",
+                atomic_load(&budget_disconnects), atomic_load(&budget_throttles));
+    }
+    lgStop();
+    for (size_t l = 0; l < LG_LEVELS; l++) {
+        if (lgDropped(l) > 0) {
+            fprintf(stderr, "Log full: %" PRIu64 " %s lines dropped.\n", lgDropped(l), lgLevelName(l));
+        }
+    }
 
-    close_all(poll_descriptors, clients);
-    
-    fclose(fp);
     return 0;
 }
@@ -6,134 +6,195 @@
 #include <string.h>
 #include <stdbool.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <stdio.h>
 #include "err.h"
 
-static const size_t CB_INITIAL_SIZE = 5000;
+static const size_t CB_INITIAL_SIZE = 16384;
 
+// Maps capacity bytes of a memfd twice back to back, so that the data starting anywhere in the
+// first copy continues in the second one. The descriptor is not needed once both views exist.
+// Returns NULL when the descriptor or the mappings are not available, e.g. at vm.max_map_count.
+static char *map_mirrored(size_t capacity)
+{
+  int fd = memfd_create("cb", MFD_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+  char *base = MAP_FAILED;
+  if (ftruncate(fd, (off_t)capacity) == 0)
+    base = mmap(NULL, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base != MAP_FAILED &&
+      (mmap(base, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+       mmap(base + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+    munmap(base, 2 * capacity);
+    base = MAP_FAILED;
+  }
+  close(fd);
+  return base == MAP_FAILED ? NULL : base;
+}
+
+static void release(CircularBuffer *b)
+{
+  if (b->mirrored)
+    munmap(b->buf, 2 * b->capacity);
+  else
+    free(b->buf);
+  b->buf = NULL;
+}
+
+// The mapping is made on the first write, connections that never send anything cost nothing.
 void cbInit(CircularBuffer *b)
 {
-  b->buf = malloc(CB_INITIAL_SIZE);
-  if (!b->buf)
-    fatal("Out of memory.");
+  b->buf = NULL;
+  b->mirrored = false;
   b->pos = 0;
-  b->capacity = CB_INITIAL_SIZE;
+  b->capacity = 0;
   b->size = 0;
+  b->scanned = 0;
+  b->read_size = CB_INITIAL_SIZE;
 }
 
 void cbDestroy(CircularBuffer *b)
 {
-  if (b->buf) {
-    free(b->buf);
-    b->buf = NULL;
-  }
+  if (b->buf)
+    release(b);
   b->size = 0;
+  b->scanned = 0;
   b->capacity = 0;
   b->pos = 0;
 }
 
+// Gives the memory back when nothing is buffered and there is more than keep bytes of it. The next
+// write starts over small.
+void cbTrim(CircularBuffer *b, size_t keep)
+{
+  if (b->size == 0 && b->capacity > keep) {
+    cbDestroy(b);
+    b->read_size = CB_INITIAL_SIZE;
+  }
+}
+
 bool cbEmpty(CircularBuffer *b) {
   return (b->size == 0);
 }
 
-void cbPushBack(CircularBuffer *b, char const *data, size_t n)
+// Makes room for at least n more bytes and returns where they go. All free space is contiguous,
+// *space tells how much there is. Returns NULL when there is no memory for it, the buffer is left
+// as it was.
+//
+// Without the mirrored mapping the buffer is plain memory. The data is kept in one piece there by
+// moving it to the front whenever it would otherwise wrap around.
+char *cbReserve(CircularBuffer *b, size_t n, size_t *space)
 {
   if (n + b->size > b->capacity) {
-    size_t oldCapacity = b->capacity;
-    size_t cm = 2;
-    while (n + b->size > cm * b->capacity)
-      cm *= 2;
-    void *newBuf = reallocarray(b->buf, cm, b->capacity);
-    if (!newBuf)
-      fatal("Out of memory.");
-    b->buf = newBuf;
-    b->capacity = cm * oldCapacity;
-
-    if (b->pos + b->size > oldCapacity)
-      memmove(b->buf + oldCapacity, b->buf, b->pos + b->size - oldCapacity);
-    if (b->pos) {
-      memmove(b->buf, b->buf + b->pos, b->size);
-      b->pos = 0;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t capacity = b->capacity ? b->capacity : CB_INITIAL_SIZE;
+    while (n + b->size > capacity)
+      capacity *= 2;
+    capacity = (capacity + page - 1) / page * page;
+
+    char *buf = map_mirrored(capacity);
+    bool mirrored = buf != NULL;
+    if (!buf && !(buf = malloc(capacity)))
+      return NULL;
+    if (b->buf) {
+      memcpy(buf, b->buf + b->pos, b->size);
+      release(b);
     }
+    b->buf = buf;
+    b->mirrored = mirrored;
+    b->pos = 0;
+    b->capacity = capacity;
   }
+  else if (!b->mirrored && b->pos + b->size + n > b->capacity) {
+    memmove(b->buf, b->buf + b->pos, b->size);
+    b->pos = 0;
+  }
+  *space = b->capacity - b->size - (b->mirrored ? 0 : b->pos);
+  return b->buf + b->pos + b->size;
+}
 
-  char *dataEnd = b->buf + ((b->pos + b->size) % b->capacity);
-  size_t spaceAtEnd = b->capacity - (dataEnd - b->buf);
-  memcpy(dataEnd, data, n > spaceAtEnd ? spaceAtEnd : n);
-  if (n > spaceAtEnd)
-    memcpy(b->buf, data + spaceAtEnd, n - spaceAtEnd);
+// Accounts n bytes written to the space returned by cbReserve.
+void cbCommit(CircularBuffer *b, size_t n)
+{
+  assert(n + b->size <= b->capacity);
   b->size += n;
 }
 
+// Returns false when there is no memory for the data.
+bool cbPushBack(CircularBuffer *b, char const *data, size_t n)
+{
+  size_t space;
+  char *dst = cbReserve(b, n, &space);
+  if (!dst)
+    return false;
+  memcpy(dst, data, n);
+  cbCommit(b, n);
+  return true;
+}
+
 void cbDropFront(CircularBuffer *b, size_t n)
 {
   assert(n <= b->size);
 
+  if (n == 0)
+    return;
   b->pos = (b->pos + n) % b->capacity;
   b->size -= n;
+  b->scanned = b->scanned > n ? b->scanned - n : 0;
 }
 
-size_t cbGetContinuousCount(CircularBuffer const *b)
-{
-  size_t possible = b->capacity - b->pos;
-  return possible > b->size ? b->size : possible;
-}
-
-size_t cbGetLineLen(CircularBuffer const *b, const char *term, size_t term_len) {
-  size_t first_chunk = cbGetContinuousCount(b);
+// Resumes where the previous unsuccessful search stopped, so a long line arriving in many
+// chunks is searched once in total. A buffer must always be searched for the same terminator.
+size_t cbGetLineLen(CircularBuffer *b, const char *term, size_t term_len) {
   const char *start = cbGetData(b);
+  // A terminator may start in the last term_len - 1 bytes searched before.
+  size_t from = b->scanned >= term_len ? b->scanned - (term_len - 1) : 0;
 
-  char *pos = memmem(start, first_chunk, term, term_len);
-  if (pos) {
-      return (size_t)(pos - start) + term_len;
-  }
-
-  size_t wrapped = b->size - first_chunk;
-  if (wrapped >= 1) {
-
-      if (term_len == 2) {
-        if (start[first_chunk - 1] == term[0] && b->buf[0] == term[1]) {
-          return first_chunk + 1;
-        }
-      }
-      char *pos2 = memmem(b->buf, wrapped, term, term_len);
-      if (pos2) {
-          return first_chunk + (pos2 - b->buf) + term_len;
+  if (from < b->size) {
+      char *pos = memmem(start + from, b->size - from, term, term_len);
+      if (pos) {
+          return (size_t)(pos - start) + term_len;
       }
   }
 
-  // term to moze byc albo \n albo \r\n wiec musimy jeszcze edge case ogarnac.
-
+  b->scanned = b->size;
   return 0;
 }
 
-size_t cbGetLine(CircularBuffer *b, char *out_line, const char* term, size_t term_len, size_t max_len) {
-  size_t total_len = cbGetLineLen(b, term, term_len);
-
-  if (total_len == 0) {
-      return 0;
-  }
-  if (total_len - term_len + 1 > max_len) {
-      return 0;
+// Copies up to n bytes from the front without consuming them, returns how many were copied.
+size_t cbPeek(CircularBuffer const *b, char *out, size_t n) {
+  if (n > b->size) {
+      n = b->size;
   }
+  memcpy(out, cbGetData(b), n);
+  return n;
+}
 
-  size_t content_len = total_len - term_len;
+// Consumes n bytes and returns them in place. They stay valid until the next cbReserve or
+// cbPushBack, so callers can parse them without copying.
+char *cbTake(CircularBuffer *b, size_t n) {
+  char *data = cbGetData(b);
+  cbDropFront(b, n);
+  return data;
+}
 
-  size_t first_chunk = cbGetContinuousCount(b);
-  const char *data = cbGetData(b);
-  if (content_len <= first_chunk) {
-      memcpy(out_line, data, content_len);
-  } else {
-      //printf("hree %ld\n", first_chunk);
-      memcpy(out_line, data, first_chunk);
-      memcpy(out_line + first_chunk, b->buf, content_len - first_chunk);
+// Consumes the next complete line and returns it without the terminator, NUL terminated where the
+// terminator started. Returns NULL when no complete line is buffered. Same lifetime as cbTake.
+char *cbTakeLine(CircularBuffer *b, const char *term, size_t term_len, size_t *len) {
+  size_t total_len = cbGetLineLen(b, term, term_len);
+  if (total_len == 0) {
+      return NULL;
   }
-  out_line[content_len] = '\0';
 
-  cbDropFront(b, total_len);
-  return content_len;
+  char *line = cbTake(b, total_len);
+  *len = total_len - term_len;
+  line[*len] = '\0';
+  return line;
 }
 
+// The data is always contiguous, thanks to the mirrored mapping or to cbReserve moving it.
 char *cbGetData(CircularBuffer const *b)
 {
   return b->buf + b->pos;
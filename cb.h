@@ -4,21 +4,32 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+// Ring buffer mapped twice back to back, so the buffered data is always contiguous. When the
+// mapping cannot be made it is plain memory whose data is moved instead of wrapping around.
 typedef struct CircularBuffer {
   char *buf;
+  bool mirrored;
   size_t pos;
   size_t capacity;
   size_t size;
+  // Length of the front already searched without finding a terminator.
+  size_t scanned;
+  // How much the next read asks for, adapted by read_message to how much data keeps coming.
+  size_t read_size;
 } CircularBuffer;
 
 void cbInit(CircularBuffer *b);
 void cbDestroy(CircularBuffer *b);
+void cbTrim(CircularBuffer *b, size_t keep);
 bool cbEmpty(CircularBuffer *b);
-void cbPushBack(CircularBuffer *b, char const *data, size_t n);
+char *cbReserve(CircularBuffer *b, size_t n, size_t *space);
+void cbCommit(CircularBuffer *b, size_t n);
+bool cbPushBack(CircularBuffer *b, char const *data, size_t n);
 void cbDropFront(CircularBuffer *b, size_t n);
-size_t cbGetContinuousCount(CircularBuffer const *b);
 char *cbGetData(CircularBuffer const *b);
-size_t cbGetLineLen(CircularBuffer const *b, const char *term, size_t term_len);
-size_t cbGetLine(CircularBuffer *b, char *out_line, const char* term, size_t term_len, size_t max_len);
+size_t cbGetLineLen(CircularBuffer *b, const char *term, size_t term_len);
+size_t cbPeek(CircularBuffer const *b, char *out, size_t n);
+char *cbTake(CircularBuffer *b, size_t n);
+char *cbTakeLine(CircularBuffer *b, const char *term, size_t term_len, size_t *len);
 
 #endif
@@ -11,17 +11,32 @@
 #include <netinet/in.h>
 #include "cb.h"
 #include "queue.h"
+#include "state.h"
 #include "common.h"
 #include "err.h"
 
+struct uring_conn;
+
 typedef struct {
+    uint64_t handle;
+    int fd;
     bool received_hello;
     bool send_coeffs;
+    // Negotiated in HELLO, all further traffic is framed.
+    bool binary;
     uint64_t hello_deadline;
     double *coeffs;
+    // f(0..K), zero until the coefficients are known.
+    double *f;
     double *approx;
+    StateLine state;
     double penalty;
     size_t put_send;
+    // Sum of (approx[x] - f[x])^2 over all points. Every PUT updates it as a compensated sum,
+    // every K + 1 PUTs it is recomputed exactly.
+    double error;
+    double error_comp;
+    size_t error_puts;
 
     CircularBuffer in_buf;
     EventQueue q;
@@ -30,27 +45,67 @@ typedef struct {
     char ipstr[INET6_ADDRSTRLEN];
     uint16_t port;
     uint64_t delay;
+
+    // Edge-triggered readiness bookkeeping.
+    bool writable;
+    bool out_armed;
+
+    // Position of the client's next deadline in the worker's timer heap.
+    size_t timer_pos;
+
+    // What the client's buffers added to the server-wide totals when they were last counted.
+    size_t in_counted;
+    size_t out_counted;
+    // Over its output limit, its input is left unread until the queue drains.
+    bool throttled;
+
+    // Row of the player on the worker's status board, SIZE_MAX without one.
+    size_t status_row;
+
+    // Only used by the io_uring backend.
+    struct uring_conn *io;
 } client_t;
 
-static inline void clientInit(client_t *c, size_t n, size_t k) {
+static inline void clientInit(client_t *c, int fd, size_t n, size_t k) {
+    c->fd = fd;
     cbInit(&c->in_buf);
     eqInit(&c->q);
     c->hello_deadline = now_ms() + 3000;
     c->coeffs = calloc(n + 1, sizeof *c->coeffs);
+    c->f = calloc(k + 1, sizeof *c->f);
     c->approx = calloc(k + 1, sizeof *c->approx);
-    if (!c->coeffs || !c->approx) fatal("Out of memory");
+    if (!c->coeffs || !c->f || !c->approx) fatal("Out of memory");
+    slInit(&c->state, k);
     c->received_hello = false;
     c->send_coeffs = false;
+    c->binary = false;
     c->penalty = 0;
     c->put_send = 0;
+    c->error = 0;
+    c->error_comp = 0;
+    c->error_puts = 0;
     c->player_id = NULL;
+    c->writable = true;
+    c->out_armed = false;
+    c->timer_pos = SIZE_MAX;
+    c->in_counted = 0;
+    c->out_counted = 0;
+    c->throttled = false;
+    c->status_row = SIZE_MAX;
+    c->io = NULL;
+}
+
+static inline double clientScore(const client_t *c) {
+    return c->penalty + (c->error + c->error_comp);
 }
 
 static inline void clientDestroy(client_t *c) {
     cbDestroy(&c->in_buf);
     eqDestroy(&c->q);
     free(c->coeffs);
+    free(c->f);
     free(c->approx);
+    slDestroy(&c->state);
     free(c->player_id);
 }
 
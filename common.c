@@ -12,6 +12,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <sys/resource.h>
 #include <time.h>
 #include <stdint.h>
 
@@ -103,23 +104,38 @@ void install_signal_handler(int signal, void (*handler)(int), int flags) {
     }
 }
 
-void get_protocol(client_params *params) {
+// Raises the soft descriptor limit to wanted, or as far as the hard limit allows.
+void raise_fd_limit(size_t wanted) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+        syserr("getrlimit");
+    }
+    if (rl.rlim_cur >= wanted) {
+        return;
+    }
+    rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY || wanted < rl.rlim_max) ? wanted : rl.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &rl) < 0) {
+        syserr("setrlimit");
+    }
+}
+
+void get_protocol(const char *server_addr, bool *ipv4, bool *ipv6) {
     struct addrinfo hints = {0}, *res;
         hints.ai_family = AF_UNSPEC;
         hints.ai_socktype = SOCK_STREAM;
 
-        int err = getaddrinfo(params->server_addr, NULL, &hints, &res);
+        int err = getaddrinfo(server_addr, NULL, &hints, &res);
         if (err != 0) {
             fatal("getaddrinfo: %s", gai_strerror(err));
         }
 
-        params->ipv4 = false;
-        params->ipv6 = false;
+        *ipv4 = false;
+        *ipv6 = false;
         if (res->ai_family == AF_INET) {
-            params->ipv4 = true;
+            *ipv4 = true;
         }
         else if (res->ai_family == AF_INET6) {
-            params->ipv6 = true;
+            *ipv6 = true;
         }
         else {
             fatal("nieobsługiwane ai_family: %d", res->ai_family);
@@ -130,12 +146,24 @@ void get_protocol(client_params *params) {
 
 
 void read_params_server(int argc, char *argv[], server_params *params) {
-    bool f_set = false, k_set = false, p_set = false, n_set = false, m_set = false;
+    bool f_set = false, k_set = false, p_set = false, n_set = false, m_set = false, t_set = false, i_set = false, c_set = false;
+    bool b_set = false, q_set = false, B_set = false, Q_set = false, l_set = false, s_set = false;
+    bool L_set = false;
 
     params->port = 0;
     params->k = 100;
     params->n = 4;
     params->m = 131;
+    params->threads = 1;
+    params->uring = false;
+    params->max_clients = 100000;
+    params->in_limit = 64 << 10;
+    params->out_limit = 16 << 20;
+    params->in_total = 1ul << 30;
+    params->out_total = 4ul << 30;
+    params->throttle = false;
+    params->status = NULL;
+    params->log_level = LG_DEBUG;
 
     // Reading params.
     for (int i = 1; i < argc; ++i) {
@@ -159,6 +187,61 @@ void read_params_server(int argc, char *argv[], server_params *params) {
             params->m = read_size(argv[++i], 1, MAX_M, "M");
             m_set = true;
         }
+        else if (strcmp(argv[i], "-t") == 0 && (i + 1 < argc) && !t_set) {
+            params->threads = read_size(argv[++i], 1, MAX_THREADS, "threads");
+            t_set = true;
+        }
+        else if (strcmp(argv[i], "-i") == 0 && (i + 1 < argc) && !i_set) {
+            char const *backend = argv[++i];
+            if (strcmp(backend, "uring") == 0) {
+                params->uring = true;
+            }
+            else if (strcmp(backend, "epoll") != 0) {
+                fatal("invalid I/O backend: %s", backend);
+            }
+            i_set = true;
+        }
+        else if (strcmp(argv[i], "-c") == 0 && (i + 1 < argc) && !c_set) {
+            params->max_clients = read_size(argv[++i], 1, MAX_CLIENTS, "max clients");
+            c_set = true;
+        }
+        else if (strcmp(argv[i], "-b") == 0 && (i + 1 < argc) && !b_set) {
+            params->in_limit = read_size(argv[++i], 1, MAX_BUDGET, "input limit");
+            b_set = true;
+        }
+        else if (strcmp(argv[i], "-q") == 0 && (i + 1 < argc) && !q_set) {
+            params->out_limit = read_size(argv[++i], 1, MAX_BUDGET, "output limit");
+            q_set = true;
+        }
+        else if (strcmp(argv[i], "-B") == 0 && (i + 1 < argc) && !B_set) {
+            params->in_total = read_size(argv[++i], 1, MAX_BUDGET, "total input limit");
+            B_set = true;
+        }
+        else if (strcmp(argv[i], "-Q") == 0 && (i + 1 < argc) && !Q_set) {
+            params->out_total = read_size(argv[++i], 1, MAX_BUDGET, "total output limit");
+            Q_set = true;
+        }
+        else if (strcmp(argv[i], "-l") == 0 && (i + 1 < argc) && !l_set) {
+            char const *policy = argv[++i];
+            if (strcmp(policy, "throttle") == 0) {
+                params->throttle = true;
+            }
+            else if (strcmp(policy, "disconnect") != 0) {
+                fatal("invalid output limit policy: %s", policy);
+            }
+            l_set = true;
+        }
+        else if (strcmp(argv[i], "-s") == 0 && (i + 1 < argc) && !s_set) {
+            params->status = argv[++i];
+            s_set = true;
+        }
+        else if (strcmp(argv[i], "-L") == 0 && (i + 1 < argc) && !L_set) {
+            char const *level = argv[++i];
+            if (!lgParseLevel(level, &params->log_level)) {
+                fatal("invalid log level: %s", level);
+            }
+            L_set = true;
+        }
         else {
             fatal("invalid parameter: %s ", argv[i]);
         }
@@ -176,6 +259,8 @@ void read_params_client(int argc, char *argv[], client_params *params) {
     params->ipv4 = false;
     params->ipv6 = false;
     params->a = false;
+    params->binary = false;
+    params->delta = false;
 
     // Reading params.
     for (int i = 1; i < argc; ++i) {
@@ -186,6 +271,13 @@ void read_params_client(int argc, char *argv[], client_params *params) {
         else if (strcmp(argv[i], "-a") == 0  && !params->a) {
             params->a = true;
         }
+        else if (strcmp(argv[i], "-b") == 0  && !params->binary) {
+            params->binary = true;
+        }
+        else if (strcmp(argv[i], "-d") == 0  && !params->delta) {
+            params->delta = true;
+            params->binary = true;
+        }
         else if (strcmp(argv[i], "-p") == 0 && (i + 1 < argc) && !p_set) {
             params->port = read_port(argv[++i]);
             if (params->port == 0) {
@@ -216,7 +308,100 @@ void read_params_client(int argc, char *argv[], client_params *params) {
     }
 
     if ((params->ipv4 && params->ipv6) || (!params->ipv4 && !params->ipv6)) {
-        get_protocol(params);
+        get_protocol(params->server_addr, &params->ipv4, &params->ipv6);
+    }
+}
+
+void read_params_bench(int argc, char *argv[], bench_params *params) {
+    bool s_set = false, p_set = false, c_set = false, t_set = false, d_set = false, r_set = false;
+    bool R_set = false, x_set = false, e_set = false, w_set = false, W_set = false, l_set = false;
+
+    params->ipv4 = false;
+    params->ipv6 = false;
+    params->players = 1000;
+    params->threads = 1;
+    params->seconds = 10;
+    params->connect_rate = 0;
+    params->put_rate = 0;
+    params->bad_percent = 0;
+    params->early_percent = 0;
+    params->slow_percent = 0;
+    params->slow_ms = 100;
+    params->lowercase = 0;
+
+    // Reading params.
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-s") == 0 && (i + 1 < argc) && !s_set) {
+            params->server_addr = argv[++i];
+            s_set = true;
+        }
+        else if (strcmp(argv[i], "-p") == 0 && (i + 1 < argc) && !p_set) {
+            params->port = read_port(argv[++i]);
+            if (params->port == 0) {
+                fatal("Port can't be 0");
+            }
+            p_set = true;
+        }
+        else if (strcmp(argv[i], "-c") == 0 && (i + 1 < argc) && !c_set) {
+            params->players = read_size(argv[++i], 1, MAX_CLIENTS, "players");
+            c_set = true;
+        }
+        else if (strcmp(argv[i], "-t") == 0 && (i + 1 < argc) && !t_set) {
+            params->threads = read_size(argv[++i], 1, MAX_THREADS, "threads");
+            t_set = true;
+        }
+        else if (strcmp(argv[i], "-d") == 0 && (i + 1 < argc) && !d_set) {
+            params->seconds = read_size(argv[++i], 1, 86400, "duration");
+            d_set = true;
+        }
+        else if (strcmp(argv[i], "-r") == 0 && (i + 1 < argc) && !r_set) {
+            params->connect_rate = read_size(argv[++i], 0, 1000000, "connect rate");
+            r_set = true;
+        }
+        else if (strcmp(argv[i], "-R") == 0 && (i + 1 < argc) && !R_set) {
+            params->put_rate = read_size(argv[++i], 0, 1000000, "PUT rate");
+            R_set = true;
+        }
+        else if (strcmp(argv[i], "-x") == 0 && (i + 1 < argc) && !x_set) {
+            params->bad_percent = read_size(argv[++i], 0, 100, "BAD_PUT percent");
+            x_set = true;
+        }
+        else if (strcmp(argv[i], "-e") == 0 && (i + 1 < argc) && !e_set) {
+            params->early_percent = read_size(argv[++i], 0, 100, "early PUT percent");
+            e_set = true;
+        }
+        else if (strcmp(argv[i], "-w") == 0 && (i + 1 < argc) && !w_set) {
+            params->slow_percent = read_size(argv[++i], 0, 100, "slow reader percent");
+            w_set = true;
+        }
+        else if (strcmp(argv[i], "-W") == 0 && (i + 1 < argc) && !W_set) {
+            params->slow_ms = read_size(argv[++i], 1, 60000, "slow read interval");
+            W_set = true;
+        }
+        else if (strcmp(argv[i], "-l") == 0 && (i + 1 < argc) && !l_set) {
+            params->lowercase = read_size(argv[++i], 0, BENCH_MAX_LOWERCASE, "lowercase letters");
+            l_set = true;
+        }
+        else if (strcmp(argv[i], "-4") == 0  && !params->ipv4) {
+            params->ipv4 = true;
+        }
+        else if (strcmp(argv[i], "-6") == 0  && !params->ipv6) {
+            params->ipv6 = true;
+        }
+        else {
+            fatal("invalid parameter: %s ", argv[i]);
+        }
+    }
+
+    if (!p_set || !s_set) {
+        fatal("Options -p, -s must be used.");
+    }
+    if (params->bad_percent + params->early_percent > 100) {
+        fatal("BAD_PUT and early PUT percents add up to more than 100");
+    }
+
+    if ((params->ipv4 && params->ipv6) || (!params->ipv4 && !params->ipv6)) {
+        get_protocol(params->server_addr, &params->ipv4, &params->ipv6);
     }
 }
 
@@ -224,4 +409,10 @@ uint64_t now_ms(void) {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
     return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
-}
\ No newline at end of file
+}
+
+uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
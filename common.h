@@ -6,9 +6,15 @@
 #include <stdbool.h>
 #include <sys/types.h>
 
+#include "logger.h"
+
 #define MAX_M 12341234
 #define MAX_K 10000
 #define MAX_N 8
+#define MAX_THREADS 64
+#define MAX_CLIENTS 1000000
+#define MAX_BUDGET (1ul << 40)
+#define BENCH_MAX_LOWERCASE 16
 
 // 1) Send uint16_t, int32_t etc., not int.
 //    The length of int is platform-dependent.
@@ -23,6 +29,20 @@ typedef struct {
     size_t k;
     size_t n;
     size_t m;
+    size_t threads;
+    bool uring;
+    size_t max_clients;
+    // Limits of buffered input and queued output, per client and over all clients.
+    size_t in_limit;
+    size_t out_limit;
+    size_t in_total;
+    size_t out_total;
+    // A client over its output limit stops being read instead of being disconnected.
+    bool throttle;
+    // Where the status endpoint listens, a port or a Unix socket path. NULL without one.
+    const char *status;
+    // Lines above this level are not logged.
+    LogLevel log_level;
 } server_params;
 
 typedef struct {
@@ -32,8 +52,33 @@ typedef struct {
     bool ipv4;
     bool ipv6;
     bool a;
+    bool binary;
+    bool delta;
 } client_params;
 
+// Simulated players of approx-bench.
+typedef struct {
+    const char *server_addr;
+    uint16_t port;
+    bool ipv4;
+    bool ipv6;
+    size_t players;
+    size_t threads;
+    size_t seconds;
+    // New connections per second over all threads, 0 connects everyone at once.
+    size_t connect_rate;
+    // PUTs per second of one player, 0 sends the next one as soon as the last was answered.
+    size_t put_rate;
+    // Shares of the PUTs with an invalid value, and of those followed right away by another one.
+    size_t bad_percent;
+    size_t early_percent;
+    // Share of the players who read their socket only every slow_ms.
+    size_t slow_percent;
+    size_t slow_ms;
+    // Lowercase letters in every player id, each delays the player's STATE by a second.
+    size_t lowercase;
+} bench_params;
+
 typedef struct __attribute__((__packed__)) {
     uint16_t seq_no;
     uint32_t number;
@@ -50,10 +95,13 @@ size_t read_size(char const *string, unsigned long min, unsigned long max, char
 struct sockaddr_in get_server_addr_ipv4(char const *host, uint16_t port);
 struct sockaddr_in6 get_server_addr_ipv6(char const *host, uint16_t port);
 void install_signal_handler(int signal, void (*handler)(int), int flags);
+void raise_fd_limit(size_t wanted);
 
 void read_params_server(int argc, char *argv[], server_params *params);
 void read_params_client(int argc, char *argv[], client_params *params);
+void read_params_bench(int argc, char *argv[], bench_params *params);
 
 uint64_t now_ms(void);
+uint64_t now_us(void);
 
 #endif
\ No newline at end of file
@@ -6,12 +6,15 @@
 #include <inttypes.h>
 
 #include "err.h"
+#include "logger.h"
 
 
 noreturn void syserr(const char* fmt, ...) {
     va_list fmt_args;
     int org_errno = errno;
 
+    // Whatever was logged before goes out first.
+    lgStop();
     fprintf(stderr, "ERROR: ");
 
     va_start(fmt_args, fmt);
@@ -25,6 +28,7 @@ noreturn void syserr(const char* fmt, ...) {
 noreturn void fatal(const char* fmt, ...) {
     va_list fmt_args;
 
+    lgStop();
     fprintf(stderr, "ERROR: ");
 
     va_start(fmt_args, fmt);
@@ -37,17 +41,19 @@ noreturn void fatal(const char* fmt, ...) {
 
 void error(const char* fmt, ...) {
     va_list fmt_args;
+    char text[ERROR_MAX];
 
-    fprintf(stderr, "ERROR: ");
-
+    // One line, so that lines of other threads do not end up in the middle of it.
     va_start(fmt_args, fmt);
-    vfprintf(stderr, fmt, fmt_args);
+    vsnprintf(text, sizeof text, fmt, fmt_args);
     va_end(fmt_args);
 
-    fprintf(stderr, "\n");
+    lgWrite(LG_ERROR, "ERROR: %s\n", text);
 }
 
 void error_msg(char* ip,char* id, uint16_t port, char* line) {
     const char *pid = id ? id : "UNKNOWN";
-    error("bad message from [%s]:%hu, %s: %s\n", ip, port, pid, line);
+    size_t len = strlen(line);
+    error("bad message from [%s]:%hu, %s: %.*s%s\n", ip, port, pid, lgCut(len), line,
+          len > LG_PAYLOAD_MAX ? "..." : "");
 }
@@ -10,6 +10,9 @@ noreturn void syserr(const char* fmt, ...);
 // Print information about an error and quits.
 noreturn void fatal(const char* fmt, ...);
 
+// Longer errors are cut.
+#define ERROR_MAX 1024
+
 // Print information about an error and return.
 void error(const char* fmt, ...);
 
@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+#include "feeder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "wire.h"
+
+// Reads the next complete line. A line that is still being written stays in the file, it is read
+// again once it is complete. Returns -1 when there is no complete line yet.
+static ssize_t read_line(FILE *fp, char **line, size_t *cap) {
+    off_t start = ftello(fp);
+    ssize_t len = getline(line, cap, fp);
+
+    if (len < 0) {
+        if (ferror(fp)) {
+            fatal("error while reading file");
+        }
+        // Drops what stdio buffered at EOF, so data written later is seen.
+        clearerr(fp);
+        fseeko(fp, 0, SEEK_CUR);
+        return -1;
+    }
+    if ((*line)[len - 1] != '\n' && start >= 0) {
+        clearerr(fp);
+        fseeko(fp, start, SEEK_SET);
+        return -1;
+    }
+    return len;
+}
+
+// Parses up to n + 1 values following "COEFF ", the line itself is not checked.
+static size_t parse_coeffs(char *line, size_t len, double *values, size_t n) {
+    size_t idx = 0;
+    char *saveptr = NULL;
+    for (char *tok = strtok_r(len > 6 ? line + 6 : line + len, " \r\n", &saveptr);
+         tok && idx <= n;
+         tok = strtok_r(NULL, " \r\n", &saveptr)) {
+        values[idx++] = strtod(tok, NULL);
+    }
+    return idx;
+}
+
+// Waits a second for the file to grow, or less when the feeder is stopped.
+static void wait_for_data(CoeffFeeder *f) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += 1;
+
+    pthread_mutex_lock(&f->lock);
+    // The task mentioned that such a situation would never occur unless something new was written
+    // to the file, so it is only an error while some client is waiting.
+    if (f->starved) {
+        error("Unexpected EOF while reading COEFF");
+    }
+    int ret = 0;
+    while (!f->stop && ret != ETIMEDOUT) {
+        ret = pthread_cond_timedwait(&f->cond, &f->lock, &until);
+    }
+    pthread_mutex_unlock(&f->lock);
+}
+
+static void *feed(void *arg) {
+    CoeffFeeder *f = arg;
+    char *line = NULL;
+    size_t cap = 0;
+    double values[f->n + 1];
+
+    pthread_mutex_lock(&f->lock);
+    while (!f->stop) {
+        if (f->count == CF_AHEAD) {
+            pthread_cond_wait(&f->cond, &f->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&f->lock);
+
+        ssize_t len = read_line(f->fp, &line, &cap);
+        if (len < 0) {
+            wait_for_data(f);
+            pthread_mutex_lock(&f->lock);
+            continue;
+        }
+        MsgBuf *msg = mbAlloc((size_t)len);
+        memcpy(msg->data, line, (size_t)len);
+        msg->data[len] = '\0';
+        msg->len = (size_t)len;
+        size_t count = parse_coeffs(line, (size_t)len, values, f->n);
+
+        pthread_mutex_lock(&f->lock);
+        size_t idx = (f->head + f->count) % CF_AHEAD;
+        f->slots[idx] = (CoeffSlot) { .line = msg, .count = count };
+        memcpy(f->values + idx * (f->n + 1), values, count * sizeof *values);
+        f->count++;
+
+        if (f->starved) {
+            f->starved = false;
+            pthread_mutex_unlock(&f->lock);
+            f->on_ready();
+            pthread_mutex_lock(&f->lock);
+        }
+    }
+    pthread_mutex_unlock(&f->lock);
+
+    free(line);
+    mbCacheFlush();
+    return NULL;
+}
+
+void cfStart(CoeffFeeder *f, const char *file, size_t n, void (*on_ready)(void)) {
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        syserr("open");
+    }
+    f->n = n;
+    f->packed = pkOpen(&f->pack, fd);
+    if (f->packed) {
+        close(fd);
+        atomic_init(&f->next, 0);
+        atomic_init(&f->exhausted, false);
+        return;
+    }
+
+    f->fp = fdopen(fd, "r");
+    if (!f->fp) {
+        syserr("fdopen");
+    }
+    f->values = malloc(CF_AHEAD * (n + 1) * sizeof *f->values);
+    if (!f->values) fatal("Out of memory");
+    f->head = f->count = 0;
+    f->starved = false;
+    f->stop = false;
+    f->on_ready = on_ready;
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->cond, NULL);
+
+    errno = pthread_create(&f->thread, NULL, feed, f);
+    if (errno != 0) {
+        syserr("pthread_create");
+    }
+}
+
+void cfStop(CoeffFeeder *f) {
+    if (f->packed) {
+        pkClose(&f->pack);
+        return;
+    }
+    pthread_mutex_lock(&f->lock);
+    f->stop = true;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+    pthread_join(f->thread, NULL);
+
+    for (size_t i = 0; i < f->count; i++) {
+        mbRelease(f->slots[(f->head + i) % CF_AHEAD].line);
+    }
+    f->count = 0;
+    free(f->values);
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->cond);
+    fclose(f->fp);
+}
+
+// A pack is not written to anymore, once it is used up the remaining clients are turned away.
+static bool take_packed(CoeffFeeder *f, CoeffLine *out, double *coeffs) {
+    size_t idx = atomic_load(&f->next);
+    do {
+        if (idx >= f->pack.count) {
+            if (!atomic_exchange(&f->exhausted, true)) {
+                error("Unexpected EOF while reading COEFF");
+            }
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak(&f->next, &idx, idx + 1));
+
+    PackLine pl = pkGet(&f->pack, idx);
+    out->msg = NULL;
+    out->line = pl.line;
+    out->line_len = pl.line_len;
+    out->count = pl.count <= f->n ? pl.count : f->n + 1;
+    // The frame would send the values beyond n + 1 as well, the caller builds a shorter one.
+    out->frame = pl.count == out->count ? pl.frame : NULL;
+    out->frame_len = pl.frame_len;
+    for (size_t i = 0; i < out->count; i++) {
+        coeffs[i] = get_f64le(pl.frame + FRAME_HEADER + 4 + i * 8);
+    }
+    return true;
+}
+
+// Hands out the next line and its values, coeffs has room for n + 1 of them. Returns false when
+// no line is ready, on_ready is called once one is.
+bool cfTake(CoeffFeeder *f, CoeffLine *out, double *coeffs) {
+    if (f->packed) {
+        return take_packed(f, out, coeffs);
+    }
+
+    pthread_mutex_lock(&f->lock);
+    if (f->count == 0) {
+        f->starved = true;
+        pthread_mutex_unlock(&f->lock);
+        return false;
+    }
+    CoeffSlot *slot = &f->slots[f->head];
+    out->msg = slot->line;
+    out->line = slot->line->data;
+    out->line_len = slot->line->len;
+    out->frame = NULL;
+    out->count = slot->count;
+    memcpy(coeffs, f->values + f->head * (f->n + 1), slot->count * sizeof *coeffs);
+    f->head = (f->head + 1) % CF_AHEAD;
+    if (f->count-- == CF_AHEAD) {
+        pthread_cond_signal(&f->cond);
+    }
+    pthread_mutex_unlock(&f->lock);
+    return true;
+}
+
+// A used up pack has no line for anybody anymore, a text file may still grow.
+bool cfExhausted(CoeffFeeder *f) {
+    return f->packed && atomic_load(&f->exhausted);
+}
@@ -0,0 +1,65 @@
+#ifndef FEEDER_H
+#define FEEDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "msgbuf.h"
+#include "pack.h"
+
+// COEFF lines read ahead of the clients that will get them.
+#define CF_AHEAD 1024
+
+typedef struct {
+    // The line as read from the file, sent to text clients.
+    MsgBuf *line;
+    size_t count;
+} CoeffSlot;
+
+// A line handed to a client. Lines of a text file come in msg, which the taker owns. Lines of a
+// pack point into its mapping, which has the binary frame ready too.
+typedef struct {
+    MsgBuf *msg;
+    const char *line;
+    size_t line_len;
+    const char *frame;
+    size_t frame_len;
+    size_t count;
+} CoeffLine;
+
+// Reads the coefficient file in its own thread, so a file that has not grown yet only delays the
+// clients waiting for a line, never the event loops. Lines come out in file order.
+// A pack made by approx-coeffpack is mapped instead and needs no thread.
+typedef struct {
+    bool packed;
+    CoeffPack pack;
+    atomic_size_t next;
+    atomic_bool exhausted;
+
+    FILE *fp;
+    size_t n;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // Ring of parsed lines, CF_AHEAD slots with n + 1 values each.
+    CoeffSlot slots[CF_AHEAD];
+    double *values;
+    size_t head;
+    size_t count;
+
+    // Somebody found the ring empty, on_ready is called once the next line is in.
+    bool starved;
+    bool stop;
+    void (*on_ready)(void);
+} CoeffFeeder;
+
+void cfStart(CoeffFeeder *f, const char *file, size_t n, void (*on_ready)(void));
+void cfStop(CoeffFeeder *f);
+bool cfTake(CoeffFeeder *f, CoeffLine *out, double *coeffs);
+bool cfExhausted(CoeffFeeder *f);
+
+#endif
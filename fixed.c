@@ -0,0 +1,104 @@
+#include "fixed.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SCALE 10000000ULL
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Writes v in decimal, right to left ending just before end. Returns the first digit.
+static char *write_digits(char *end, uint64_t v, int min_digits) {
+    char *p = end;
+    while (v >= 100) {
+        p -= 2;
+        memcpy(p, &digit_pairs[(v % 100) * 2], 2);
+        v /= 100;
+        min_digits -= 2;
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, &digit_pairs[v * 2], 2);
+        min_digits -= 2;
+    }
+    else {
+        *--p = (char)('0' + v);
+        min_digits--;
+    }
+    while (min_digits-- > 0) {
+        *--p = '0';
+    }
+    return p;
+}
+
+// value * 10^7 rounded to an integer exactly like printf does: the binary value is exact,
+// ties go to even. Returns false when the result does not fit 64 bits.
+static bool scaled(double value, uint64_t *out) {
+    int exp;
+    double frac = frexp(fabs(value), &exp);
+    // value = mant * 2^(exp - 53) with an integer mantissa below 2^53.
+    uint64_t mant = (uint64_t)ldexp(frac, 53);
+    int shift = exp - 53;
+    unsigned __int128 product = (unsigned __int128)mant * SCALE;
+
+    if (shift >= 0) {
+        if (shift > 11 || (product << shift) >> 64 != 0) {
+            return false;
+        }
+        *out = (uint64_t)(product << shift);
+        return true;
+    }
+    if (-shift >= 128) {
+        *out = 0;
+        return true;
+    }
+
+    unsigned __int128 q = product >> -shift;
+    unsigned __int128 rem = product - (q << -shift);
+    unsigned __int128 half = (unsigned __int128)1 << (-shift - 1);
+    if (rem > half || (rem == half && (q & 1))) {
+        q++;
+    }
+    if (q >> 64 != 0) {
+        return false;
+    }
+    *out = (uint64_t)q;
+    return true;
+}
+
+// Same bytes as snprintf("%.7f") in the C locale, without going through stdio for usual values.
+// out must hold FIXED7_MAX bytes. Returns the length, the output is NUL-terminated.
+size_t format_fixed7(char *out, double value) {
+    uint64_t q;
+    if (!isfinite(value) || !scaled(value, &q)) {
+        return (size_t)snprintf(out, FIXED7_MAX, "%.7f", value);
+    }
+
+    char tmp[32];
+    char *end = tmp + sizeof tmp;
+    char *p = write_digits(end, q % SCALE, 7);
+    *--p = '.';
+    p = write_digits(p, q / SCALE, 1);
+    // Like printf, the sign of a negative zero or of a value rounding to zero is kept.
+    if (signbit(value)) {
+        *--p = '-';
+    }
+
+    size_t len = (size_t)(end - p);
+    memcpy(out, p, len);
+    out[len] = '\0';
+    return len;
+}
@@ -0,0 +1,11 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <stddef.h>
+
+// Longest "%.7f" of a double: 309 integer digits, sign, dot, 7 decimals and the NUL.
+#define FIXED7_MAX 320
+
+size_t format_fixed7(char *out, double value);
+
+#endif
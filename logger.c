@@ -0,0 +1,263 @@
+#include "logger.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "err.h"
+
+// Lines are cut into slots of a ring shared by all threads, a line takes consecutive slots.
+#define LG_SLOTS (1 << 15)
+#define LG_SLOT_TEXT 112
+// The flusher looks at the ring this often, and sooner once it is half full.
+#define LG_FLUSH_MS 10
+// Bytes the flusher gathers per write.
+#define LG_BATCH (64 << 10)
+// Lines up to this long are formatted on the stack.
+#define LG_LINE 512
+
+typedef struct {
+    // Position + 1 once the slot holds text of that position, position + LG_SLOTS once it was
+    // flushed and can take the position one lap later.
+    atomic_size_t seq;
+    uint32_t len;
+    uint32_t level;
+    char text[LG_SLOT_TEXT];
+} Slot;
+
+static const char *level_names[LG_LEVELS] = {
+    [LG_ERROR] = "error",
+    [LG_INFO] = "info",
+    [LG_DEBUG] = "debug",
+};
+
+static Slot *slots;
+static alignas(64) atomic_size_t tail;
+static alignas(64) atomic_size_t head;
+static alignas(64) atomic_bool running;
+static atomic_bool stopping;
+static LogLevel max_level = LG_DEBUG;
+static atomic_uint_fast64_t dropped[LG_LEVELS];
+static int wake_fd = -1;
+static pthread_t flusher;
+// Batches of the flusher, for stdout and stderr.
+static char out[2][LG_BATCH + LG_SLOT_TEXT];
+
+bool lgParseLevel(const char *name, LogLevel *level) {
+    for (size_t l = 0; l < LG_LEVELS; l++) {
+        if (strcmp(name, level_names[l]) == 0) {
+            *level = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *lgLevelName(LogLevel level) {
+    return level_names[level];
+}
+
+bool lgEnabled(LogLevel level) {
+    return level <= max_level;
+}
+
+// Messages longer than LG_PAYLOAD_MAX are cut, for use as a "%.*s" precision.
+int lgCut(size_t len) {
+    return len > LG_PAYLOAD_MAX ? LG_PAYLOAD_MAX : (int)len;
+}
+
+uint64_t lgDropped(LogLevel level) {
+    return atomic_load_explicit(&dropped[level], memory_order_relaxed);
+}
+
+static void wake_flusher(void) {
+    uint64_t one = 1;
+    // The counter only overflows if the flusher is gone, then there is nothing to wake.
+    (void)!write(wake_fd, &one, sizeof one);
+}
+
+// Never waits: without room for the whole line the line is dropped and counted.
+static void push(LogLevel level, const char *line, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    size_t count = (len + LG_SLOT_TEXT - 1) / LG_SLOT_TEXT;
+    if (count > LG_SLOTS / 2) {
+        count = LG_SLOTS / 2;
+        len = count * LG_SLOT_TEXT;
+    }
+
+    size_t pos = atomic_load_explicit(&tail, memory_order_relaxed);
+    while (true) {
+        // The flusher frees slots in order, so the last one being free means they all are.
+        size_t last = pos + count - 1;
+        size_t seq = atomic_load_explicit(&slots[last & (LG_SLOTS - 1)].seq, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)(seq - last);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&tail, &pos, pos + count, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            atomic_fetch_add_explicit(&dropped[level], 1, memory_order_relaxed);
+            return;
+        }
+        else {
+            pos = atomic_load_explicit(&tail, memory_order_relaxed);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        Slot *s = &slots[(pos + i) & (LG_SLOTS - 1)];
+        size_t part = len < LG_SLOT_TEXT ? len : LG_SLOT_TEXT;
+        memcpy(s->text, line, part);
+        s->len = part;
+        s->level = level;
+        atomic_store_explicit(&s->seq, pos + i + 1, memory_order_release);
+        line += part;
+        len -= part;
+    }
+
+    // Only the line that fills the ring past half wakes the flusher early.
+    size_t fill = pos + count - atomic_load_explicit(&head, memory_order_relaxed);
+    if (fill >= LG_SLOTS / 2 && fill - count < LG_SLOTS / 2) {
+        wake_flusher();
+    }
+}
+
+void lgWriteV(LogLevel level, const char *fmt, va_list args) {
+    if (level > max_level) {
+        return;
+    }
+    if (!atomic_load_explicit(&running, memory_order_acquire)) {
+        vfprintf(level == LG_ERROR ? stderr : stdout, fmt, args);
+        return;
+    }
+
+    char small[LG_LINE];
+    char *line = small;
+    va_list again;
+    va_copy(again, args);
+    int len = vsnprintf(small, sizeof small, fmt, args);
+    if (len >= (int)sizeof small) {
+        line = malloc(len + 1);
+        if (line) {
+            vsnprintf(line, len + 1, fmt, again);
+        }
+        else {
+            // The start of a line is better than none.
+            line = small;
+            len = sizeof small - 1;
+        }
+    }
+    va_end(again);
+
+    if (len > 0) {
+        push(level, line, len);
+    }
+    if (line != small) {
+        free(line);
+    }
+}
+
+void lgWrite(LogLevel level, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    lgWriteV(level, fmt, args);
+    va_end(args);
+}
+
+static void write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Nowhere to report it, the rest of the batch is lost.
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+// Copies published slots into one buffer per descriptor and writes them, off every event loop.
+static void *flush_loop(void *arg) {
+    (void)arg;
+    size_t pos = atomic_load_explicit(&head, memory_order_relaxed);
+    while (true) {
+        bool stop = atomic_load_explicit(&stopping, memory_order_acquire);
+        size_t len[2] = {0, 0};
+        size_t taken = 0;
+        while (len[0] < LG_BATCH && len[1] < LG_BATCH) {
+            Slot *s = &slots[pos & (LG_SLOTS - 1)];
+            if (atomic_load_explicit(&s->seq, memory_order_acquire) != pos + 1) {
+                break;
+            }
+            size_t o = s->level == LG_ERROR;
+            memcpy(out[o] + len[o], s->text, s->len);
+            len[o] += s->len;
+            atomic_store_explicit(&s->seq, pos + LG_SLOTS, memory_order_release);
+            pos++;
+            taken++;
+        }
+        atomic_store_explicit(&head, pos, memory_order_relaxed);
+        write_all(STDOUT_FILENO, out[0], len[0]);
+        write_all(STDERR_FILENO, out[1], len[1]);
+
+        if (taken == 0) {
+            // A line reserved but never published is left behind at exit.
+            if (stop) {
+                break;
+            }
+            struct pollfd pfd = {.fd = wake_fd, .events = POLLIN};
+            if (poll(&pfd, 1, LG_FLUSH_MS) > 0) {
+                uint64_t count;
+                (void)!read(wake_fd, &count, sizeof count);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Lines above the given level are skipped. Until lgStart and after lgStop lines are printed
+// directly, as the client does.
+void lgStart(LogLevel level) {
+    max_level = level;
+    slots = aligned_alloc(64, LG_SLOTS * sizeof(Slot));
+    if (!slots) fatal("Out of memory");
+    for (size_t i = 0; i < LG_SLOTS; i++) {
+        atomic_init(&slots[i].seq, i);
+    }
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) syserr("eventfd");
+
+    // Anything printed before goes first.
+    fflush(stdout);
+    int err = pthread_create(&flusher, NULL, flush_loop, NULL);
+    if (err != 0) {
+        errno = err;
+        syserr("pthread_create");
+    }
+    atomic_store_explicit(&running, true, memory_order_release);
+}
+
+// Writes out everything logged so far. Safe to call more than once, and from fatal. The ring and
+// the eventfd are kept, a thread still inside lgWrite may use them.
+void lgStop(void) {
+    if (!atomic_exchange(&running, false)) {
+        return;
+    }
+    atomic_store_explicit(&stopping, true, memory_order_release);
+    wake_flusher();
+    pthread_join(flusher, NULL);
+}
@@ -0,0 +1,31 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ERROR lines go to stderr, the others to stdout. DEBUG has a line for every PUT and every message
+// sent, INFO only connections and games.
+typedef enum {
+    LG_ERROR,
+    LG_INFO,
+    LG_DEBUG,
+    LG_LEVELS
+} LogLevel;
+
+// Protocol messages in log lines are cut to this many bytes, a STATE line can be megabytes long.
+#define LG_PAYLOAD_MAX 160
+
+bool lgParseLevel(const char *name, LogLevel *level);
+const char *lgLevelName(LogLevel level);
+void lgStart(LogLevel level);
+void lgStop(void);
+bool lgEnabled(LogLevel level);
+void lgWrite(LogLevel level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void lgWriteV(LogLevel level, const char *fmt, va_list args);
+int lgCut(size_t len);
+uint64_t lgDropped(LogLevel level);
+
+#endif
@@ -15,30 +15,63 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <float.h>
-#include <regex.h>
+#include <stdarg.h>
 
 #include "err.h"
 #include "common.h"
 #include "cb.h"
 #include "queue.h"
 #include "client.h"
-
-#define BUF_SIZE 10000
-
-bool is_matching(const char *pattern, const char *line) {
-    regex_t regex;
-    int ret;
-
-    ret = regcomp(&regex, pattern, REG_EXTENDED);
-    if (ret != 0) {
-
-        return false;
+#include "fixed.h"
+#include "wire.h"
+#include "metrics.h"
+#include "logger.h"
+
+#define READ_MAX (1 << 20)
+
+// Exact powers of ten for the fraction digits a protocol number may have.
+static const double pow10_table[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7 };
+
+// Matches -?[0-9]+(\.[0-9]{0,7})? at s and stores its value. Returns the position after it,
+// or NULL when s does not start with such a number. Anything may follow, including '\0'.
+static const char *scan_rational(const char *s, double *out) {
+    const char *start = s;
+    bool negative = *s == '-';
+    if (negative) s++;
+    if (!isdigit((unsigned char)*s)) return NULL;
+
+    // Up to 15 digits the mantissa and 10^fraction are exact doubles, so one division rounds
+    // exactly like strtod. Longer numbers are rare enough to hand over to strtod.
+    uint64_t mantissa = 0;
+    size_t digits = 0;
+    while (isdigit((unsigned char)*s)) {
+        if (mantissa != 0 || *s != '0') {
+            digits++;
+        }
+        mantissa = mantissa * 10 + (uint64_t)(*s++ - '0');
     }
 
-    ret = regexec(&regex, line, 0, NULL, 0);
-    regfree(&regex);
+    size_t fraction = 0;
+    if (*s == '.') {
+        s++;
+        while (isdigit((unsigned char)*s) && fraction < 7) {
+            if (mantissa != 0 || *s != '0') {
+                digits++;
+            }
+            mantissa = mantissa * 10 + (uint64_t)(*s++ - '0');
+            fraction++;
+        }
+        if (isdigit((unsigned char)*s)) return NULL;
+    }
 
-    return (ret == 0);
+    if (digits <= 15) {
+        double value = (double)mantissa / pow10_table[fraction];
+        *out = negative ? -value : value;
+    }
+    else {
+        *out = strtod(start, NULL);
+    }
+    return s;
 }
 
 bool is_valid_player_id(const char *s) {
@@ -58,107 +91,167 @@ size_t count_lowercase(const char *s) {
     return cnt;
 }
 
-static bool is_rational(const char *s, size_t len) {
-    if (*s == '-') {
-        s++;
-        len--;
-    }
-
-    if (len == 0) return false;
-    if (!isdigit((unsigned char)*s)) return false;
-    while (isdigit((unsigned char)*s) && len > 0) {
-        s++;
-        len--;
+// Space separated numbers, as in COEFF and STATE.
+bool is_valid_state_coeff(const char *line) {
+    double value;
+    while ((line = scan_rational(line, &value)) && *line == ' ') {
+        line++;
     }
+    return line && *line == '\0';
+}
 
-    if (len == 0) return true;
-    if (*s != '.') return false;
-    s++;
-    len--;
-    if (len > 7) return false;
+// "<number> <number>", as in BAD_PUT and PENALTY.
+bool is_valid_bad_put(const char *line) {
+    double value;
+    line = scan_rational(line, &value);
+    if (!line || *line != ' ') return false;
+    line = scan_rational(line + 1, &value);
+    return line && *line == '\0';
+}
 
-    for (size_t i = 0; i < len; i++) {
-        if (!isdigit((unsigned char)*s)) 
-            return false;
-        s++;
+// Space separated pairs of a player id and a score.
+bool is_valid_scoring(const char *line) {
+    double value;
+    while (true) {
+        const char *id = line;
+        while (isalnum((unsigned char)*line)) {
+            line++;
+        }
+        if (line == id || *line != ' ') return false;
+        line = scan_rational(line + 1, &value);
+        if (!line) return false;
+        if (*line == '\0') return true;
+        if (*line++ != ' ') return false;
     }
-    return true;
 }
 
-bool is_valid_state_coeff(char *line) {
-    const char *pattern = "^-?[0-9]+(\\.[0-9]{0,7})?( -?[0-9]+(\\.[0-9]{0,7})?)*$";
-    return is_matching(pattern, line);
-}
+// Splits "<point> <value>" in place and parses both numbers while checking them.
+bool is_valid_put(char *line, size_t linelen, char **point_str, char **value_str,
+        double *point, double *value) {
+    const char *end = line + linelen;
+    const char *sp = scan_rational(line, point);
+    if (!sp || sp == end || *sp != ' ') {
+        return false;
+    }
+    const char *last = scan_rational(sp + 1, value);
+    if (last != end) {
+        return false;
+    }
 
-bool is_valid_bad_put(char *line) {
-    const char *pattern = "^-?[0-9]+(\\.[0-9]{0,7})? -?[0-9]+(\\.[0-9]{0,7})?$";
-    return is_matching(pattern, line);
+    line[sp - line] = '\0';
+    *point_str = line;
+    *value_str = line + (sp - line) + 1;
+    return true;
 }
 
-bool is_valid_scoring(char *line) {
-    const char *pattern = "^[A-Za-z0-9]+ -?[0-9]+(\\.[0-9]{0,7})?( [A-Za-z0-9]+ -?[0-9]+(\\.[0-9]{0,7})?)*$";
-    return is_matching(pattern, line);
+// A point has no sign and only zeros after the decimal point.
+static bool is_valid_point(const char *s) {
+    while (isdigit((unsigned char)*s)) {
+        s++;
+    }
+    if (*s == '.') {
+        s++;
+        while (*s == '0') {
+            s++;
+        }
+    }
+    return *s == '\0';
 }
 
-bool is_valid_put(const char *line, size_t linelen, char** point, char** value) {
-    char *sp = memchr(line, ' ', linelen);
-    if (!sp) {
+// Checks the numbers parsed by is_valid_put against the game limits.
+bool valid_point_value(const char *point_str, double point, double value,
+        size_t *out_point, size_t K) {
+    if (!is_valid_point(point_str) || point > (double) K) {
         return false;
     }
-
-    size_t point_len = sp - line;
-    size_t value_len = linelen - point_len - 1; // odejmuje 2 bo ma na koncu \n
-
-    if (!is_rational(line, point_len) || !is_rational(sp+1, value_len)) {
+    if (value < -5.0 || value > 5.0) {
         return false;
     }
 
-    *sp = '\0';
-
-    *point = (char *)line;
-    *value = (char *)(sp + 1);
-
+    *out_point = (size_t) point;
     return true;
 }
 
-bool is_valid_point(char *line) {
-    const char *pattern = "^[0-9]+(\\.[0]{0,7})?$";
-    return is_matching(pattern, line);
+// Fills iov with the messages that are due, in sending order. Returns the number of iovecs.
+size_t gather_data_to_send(EventQueue *q, struct iovec *iov, size_t max) {
+    eqCollectDue(q, now_ms());
+    return eqReadyIov(q, iov, max);
 }
 
-bool valid_point_value(char *point_str, char *value_str,
-        size_t *out_point, double *out_value, size_t K) {
-
-    if (!is_valid_point(point_str))
-        return false;
-
-    char *endptr;
-    errno = 0;
+// Kind of a message as the metrics count it, text lines are told apart by their first letters.
+static MessageKind message_kind(const char *data) {
+    if (is_frame(data)) {
+        switch ((uint8_t)data[0]) {
+            case FRAME_COEFF: return MT_COEFF;
+            case FRAME_PUT: return MT_PUT;
+            case FRAME_BAD_PUT: return MT_BAD_PUT;
+            case FRAME_PENALTY: return MT_PENALTY;
+            case FRAME_SCORING: return MT_SCORING;
+            default: return MT_STATE;
+        }
+    }
+    switch (data[0]) {
+        case 'H': return MT_HELLO;
+        case 'C': return MT_COEFF;
+        case 'B': return MT_BAD_PUT;
+        case 'P': return data[1] == 'E' ? MT_PENALTY : MT_PUT;
+        default: return data[1] == 'T' ? MT_STATE : MT_SCORING;
+    }
+}
 
-    double point = strtod(point_str, &endptr);
-    if (errno != 0 || *endptr != '\0' || point > (double) K || point < 0) {
-        return false;
+static void log_sent(const char *id, const char *data, size_t len) {
+    if (is_frame(data)) {
+        lgWrite(LG_DEBUG, "Sending %s message: %s frame (%zu bytes)\n", id, frame_name((uint8_t)data[0]), len);
     }
+    else {
+        // A STATE line holds every point, only its start is worth a log line.
+        lgWrite(LG_DEBUG, "Sending %s message: %.*s%s", id, lgCut(len), data,
+                len > LG_PAYLOAD_MAX ? "...\n" : "");
+    }
+}
 
-    errno = 0;
-    double value = strtod(value_str, &endptr);
-    if (errno != 0 || *endptr != '\0' || value < -5.0 || value > 5.0) {
-        return false;
+// Accounts n bytes written across the gathered messages, returns true when none is left ready.
+bool data_sent(EventQueue *q, size_t n, char *id) {
+    Metrics *m = mtLocal;
+    uint64_t now = 0;
+    if (m) {
+        mtAdd(&m->bytes_out, n);
+        now = mtClockAfterWrite(m, n);
     }
+    while (n > 0) {
+        ScheduledEvent *evt = eqReady(q, 0);
+        size_t part = n < evt->remaining ? n : evt->remaining;
+        eqUpdate(q, part);
+        n -= part;
 
-    *out_point = (size_t) point;
-    *out_value = value;
-    return true;
+        if (evt->remaining == 0) {
+            const char *data = eqData(evt);
+            if (m) {
+                uint64_t due = evt->send_time * 1000;
+                mtAdd(&m->sent[message_kind(data)], 1);
+                mtObserve(&m->send_lag, now > due ? now - due : 0);
+            }
+            if (lgEnabled(LG_DEBUG)) {
+                log_sent(id, data, evt->sent);
+            }
+            eqPop(q);
+        }
+    }
+    return q->ready_count == 0;
 }
 
+// Writes all due messages with one writev per batch of SEND_IOV_MAX.
 ssize_t process_data_to_send(EventQueue* q, int fd, char* id) {
-    uint64_t now = now_ms();
-    ScheduledEvent *evt;
+    struct iovec iov[SEND_IOV_MAX];
+    size_t count;
 
-    while(!eqEmpty(q) && eqPeek(q)->send_time <= now) {
-        evt = eqPeek(q);
+    while ((count = gather_data_to_send(q, iov, SEND_IOV_MAX)) > 0) {
+        size_t total = 0;
+        for (size_t i = 0; i < count; i++) {
+            total += iov[i].iov_len;
+        }
 
-        ssize_t bytes_send = write(fd, evt->ptr, evt->remaining);
+        ssize_t bytes_send = writev(fd, iov, (int)count);
 
         if (bytes_send < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -166,24 +259,26 @@ ssize_t process_data_to_send(EventQueue* q, int fd, char* id) {
             return -1;
         }
 
-        evt->ptr += (size_t)bytes_send;
-        evt->remaining -= (size_t)bytes_send;
-        
-        if (evt->remaining == 0) {
-            printf("Sending %s message: %s", id, evt->msg);
-            eqPop(q);
-        }
-        else {
+        data_sent(q, (size_t)bytes_send, id);
+        if ((size_t)bytes_send < total) {
             return 0;
         }
     }
     return 1;
 }
 
+// Reads straight into the buffer. A read that fills the space it was given suggests more is
+// pending, so the next one asks for twice as much, up to READ_MAX. Without memory for the buffer
+// it fails like a read, with errno ENOMEM.
 ssize_t read_message(CircularBuffer *input_messages, int fd) {
-    char buffer[BUF_SIZE];
-    
-    ssize_t n = read(fd, buffer, BUF_SIZE);
+    size_t space;
+    char *dst = cbReserve(input_messages, input_messages->read_size, &space);
+    if (!dst) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    ssize_t n = read(fd, dst, space);
 
     if (n < 0) {
         if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -191,19 +286,23 @@ ssize_t read_message(CircularBuffer *input_messages, int fd) {
         return -1;
     }
 
-    cbPushBack(input_messages, buffer, n); 
+    cbCommit(input_messages, (size_t)n);
+    MT_COUNT(bytes_in, (size_t)n);
+    if ((size_t)n == space && input_messages->read_size < READ_MAX) {
+        input_messages->read_size *= 2;
+    }
     return n;
 }
 
-ssize_t send_hello(const char *player_id, EventQueue *q, int fd) {
-
-    size_t len = 6 + strlen(player_id) + 2 + 1;
-    char *buf = malloc(len);
-    if (!buf) fatal("Out of memory");
-    snprintf(buf, len, "HELLO %s\r\n", player_id);
+// caps is NULL for the text protocol, otherwise HELLO_BINARY or HELLO_DELTA.
+ssize_t send_hello(const char *player_id, const char *caps, EventQueue *q, int fd) {
 
-    eqPush(q, now_ms(), buf, false);
-    free(buf);
+    if (caps) {
+        queue_msg(q, now_ms(), false, "HELLO %s %s\r\n", player_id, caps);
+    }
+    else {
+        queue_msg(q, now_ms(), false, "HELLO %s\r\n", player_id);
+    }
 
     while(!eqEmpty(q)) {
         if (process_data_to_send(q, fd, "server") < 0)
@@ -212,126 +311,147 @@ ssize_t send_hello(const char *player_id, EventQueue *q, int fd) {
     return 1;
 }
 
-double *read_coeffs(char* payload, size_t *count) {
-
+// Validates and parses a COEFF payload in one pass. Returns NULL when it is malformed.
+double *read_coeffs(const char *payload, size_t *count) {
+    size_t capacity = 16;
     size_t coeff_count = 0;
-    char *copy = strdup(payload);
-    if (!copy) {
-        syserr("strdup");
-    }
+    double *coeffs = malloc(capacity * sizeof *coeffs);
+    if (!coeffs)
+        fatal("Out of memory");
 
-    char *saveptr, *tok;
-    for (tok = strtok_r(copy, " ", &saveptr);tok != NULL; tok = strtok_r(NULL, " ", &saveptr)) {
+    while (true) {
+        if (coeff_count == capacity) {
+            capacity *= 2;
+            double *tmp = realloc(coeffs, capacity * sizeof *coeffs);
+            if (!tmp) fatal("Out of memory");
+            coeffs = tmp;
+        }
+        payload = scan_rational(payload, &coeffs[coeff_count]);
+        if (!payload) break;
         coeff_count++;
+        if (*payload == '\0') {
+            *count = coeff_count;
+            return coeffs;
+        }
+        if (*payload++ != ' ') break;
     }
 
-    free(copy);
+    free(coeffs);
+    return NULL;
+}
 
-    double *coeffs = malloc(coeff_count * sizeof *coeffs);
-    if (!coeffs) 
-        fatal("Out of memory");
+// Formats a message straight into the queue, short ones end up inline in the event without any allocation.
+void queue_msg(EventQueue *q, uint64_t when, bool is_put_response, const char *fmt, ...) {
+    char small[EQ_INLINE_SIZE + 1];
+    va_list args;
 
-    size_t id = 0;
-    for (tok = strtok_r(payload, " ", &saveptr);tok != NULL; tok = strtok_r(NULL, " ", &saveptr)) {
-        coeffs[id++] = strtod(tok, NULL);
-    }
+    va_start(args, fmt);
+    int n = vsnprintf(small, sizeof small, fmt, args);
+    va_end(args);
+    if (n < 0) fatal("vsnprintf");
 
-    *count = coeff_count;
+    if ((size_t)n <= EQ_INLINE_SIZE) {
+        eqPushInline(q, when, small, (size_t)n, is_put_response);
+        return;
+    }
 
-    return coeffs;
+    MsgBuf *buf = mbAlloc((size_t)n);
+    va_start(args, fmt);
+    vsnprintf(buf->data, (size_t)n + 1, fmt, args);
+    va_end(args);
+    buf->len = (size_t)n;
+    eqPush(q, when, buf, is_put_response);
 }
 
-char *create_penalty_msg(const char *point_str, const char *value_str) {
-    size_t len = 8 + strlen(point_str) + 1 + strlen(value_str) + 2 + 1;
-    char *buf = malloc(len);
-    if (!buf) fatal("Out of memory");
-    snprintf(buf, len, "PENALTY %s %s\r\n", point_str, value_str);
-    return buf;
+// Text messages always start with a capital letter, frames with their type.
+bool is_frame(const char *data) {
+    return (unsigned char)data[0] < 'A';
 }
 
-char *create_badput_msg(const char *point_str, const char *value_str) {
-    size_t len = 8 + strlen(point_str) + 1 + strlen(value_str) + 2 + 1;
-    char *buf = malloc(len);
-    if (!buf) fatal("Out of memory");
-    snprintf(buf, len, "BAD_PUT %s %s\r\n", point_str, value_str);
-    return buf;
+const char *frame_name(uint8_t type) {
+    switch (type) {
+        case FRAME_COEFF: return "COEFF";
+        case FRAME_PUT: return "PUT";
+        case FRAME_STATE: return "STATE";
+        case FRAME_BAD_PUT: return "BAD_PUT";
+        case FRAME_PENALTY: return "PENALTY";
+        case FRAME_SCORING: return "SCORING";
+        case FRAME_STATE_DELTA: return "STATE_DELTA";
+        case FRAME_STATE_SPARSE: return "STATE_SPARSE";
+        default: return "UNKNOWN";
+    }
 }
 
-char *create_put_msg(const char *point, const char *value) {
-    size_t len = 4 + strlen(point) + 1 + strlen(value) + 2 + 1;
-    char *buf = malloc(len);
-    if (!buf) fatal("Out of memory");
-    snprintf(buf, len, "PUT %s %s\r\n", point, value);
-    return buf;
+// Queues a PUT, BAD_PUT or PENALTY frame, it always fits inline.
+void queue_point_frame(EventQueue *q, uint64_t when, bool is_put_response, uint8_t type, uint32_t point, double value) {
+    char frame[FRAME_HEADER + FRAME_POINT_VALUE];
+    put_frame_header(frame, type, FRAME_POINT_VALUE);
+    put_u32le(frame + FRAME_HEADER, point);
+    put_f64le(frame + FRAME_HEADER + 4, value);
+    eqPushInline(q, when, frame, sizeof frame, is_put_response);
 }
 
-char *create_state_msg(double *approx, size_t K) {
-    size_t estimate = 6 + (K + 1) * 32 + K + 2 + 1;
-    char *buf = malloc(estimate);
-    if (!buf) fatal("Out of memory");
-    char *p = buf;
-    size_t remaining = estimate;
-
-    int n = snprintf(p, remaining, "STATE");
-    p += n; 
-    remaining -= n;
-
-    for (size_t i = 0; i <= K; ++i) {
-        *p++ = ' '; 
-        remaining--;
-        n = snprintf(p, remaining, "%.7f", approx[i]);
-        p += n; 
-        remaining -= n;
-    }
-    *p++ = '\r'; 
-    *p++ = '\n'; 
-    *p = '\0';
-
+// COEFF and STATE frames: the values as little-endian doubles, no formatting involved.
+MsgBuf *create_values_frame(uint8_t type, const double *values, size_t count) {
+    size_t len = 4 + count * 8;
+    MsgBuf *buf = mbAlloc(FRAME_HEADER + len);
+    char *p = buf->data;
+    put_frame_header(p, type, (uint32_t)len);
+    put_u32le(p + FRAME_HEADER, (uint32_t)count);
+    p += FRAME_HEADER + 4;
+    for (size_t i = 0; i < count; i++) {
+        put_f64le(p + i * 8, values[i]);
+    }
+    buf->len = FRAME_HEADER + len;
+    buf->data[buf->len] = '\0';
     return buf;
 }
 
-bool get_line(CircularBuffer *cb,
-                  const char *term, size_t term_len,
-                  char **line_ptr, size_t *cap_ptr,
-                  size_t *out_len)
+// Frame counterpart of cbTakeLine. Returns 1 and the payload once the whole frame arrived, 0 while
+// it is incomplete and -1 when the announced payload is longer than max_len. The payload lives
+// as long as a line returned by cbTake.
+int get_frame(CircularBuffer *cb, size_t max_len, uint8_t *type, const char **payload, size_t *out_len)
 {
-    size_t total_len;
-    if ((total_len = cbGetLineLen(cb, term, term_len)) == 0) {
-        return false;
+    char header[FRAME_HEADER];
+    if (cbPeek(cb, header, FRAME_HEADER) < FRAME_HEADER) {
+        return 0;
     }
-
-    size_t content_len = total_len - term_len;
-
-
-    if (content_len + 1 > *cap_ptr) {
-        size_t new_cap = content_len + 1;
-        char *tmp = realloc(*line_ptr, new_cap);
-        if (!tmp) fatal("Out of memory");
-        *line_ptr = tmp;
-        *cap_ptr   = new_cap;
+    size_t len = get_u32le(header + 1);
+    if (len > max_len) {
+        return -1;
+    }
+    if (cb->size < FRAME_HEADER + len) {
+        return 0;
     }
 
-    cbGetLine(cb, *line_ptr, term, term_len, *cap_ptr);
-
-    *out_len = content_len;
-    return true;
+    cbDropFront(cb, FRAME_HEADER);
+    *payload = cbTake(cb, len);
+    *type = (uint8_t)header[0];
+    *out_len = len;
+    return 1;
 }
 
-double calculate_f(size_t n, double* coeffs, size_t x) {
-    double fx = 0.0;
-    double xi = 1.0;
-    for (size_t i = 0; i <= n; i++) {
-        fx  += coeffs[i] * xi;
-        xi  *= (double)x;
+// Space separated "%.7f" values of a COEFF or STATE payload, for printing.
+char *format_values(const char *values, size_t count) {
+    char *out = malloc(count * (FIXED7_MAX + 1) + 1);
+    if (!out) fatal("Out of memory");
+    char *p = out;
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) {
+            *p++ = ' ';
+        }
+        p += format_fixed7(p, get_f64le(values + i * 8));
     }
-    return fx;
+    *p = '\0';
+    return out;
 }
 
-double calculate_score(size_t n, double* coeffs, double* approx, size_t k, size_t penalty) {
-    double score = (double)penalty;
+// f holds f(0..k), filled by pfFill when the client got its coefficients. During the game the
+// server keeps this sum up to date itself, see update_error.
+double calculate_score(const double *f, const double *approx, size_t k, double penalty) {
+    double score = penalty;
     for (size_t x = 0; x <= k; x++) {
-        double fx = calculate_f(n, coeffs, x);
-        double diff = approx[x] - fx;
+        double diff = approx[x] - f[x];
         score += diff * diff;
     }
     return score;
@@ -343,47 +463,58 @@ static int cmp_client_by_id(const void *pa, const void *pb) {
     return strcmp((*a)->player_id, (*b)->player_id);
 }
 
-char *create_scoring_msg(client_t **clients, size_t client_count, size_t n, size_t k) {
+// Text SCORING line or, for binary clients, the SCORING frame.
+MsgBuf *create_scoring_msg(client_t **clients, size_t client_count, bool binary) {
     client_t **arr = malloc(client_count * sizeof *arr);
     if (!arr) fatal("Out of memory");
     memcpy(arr, clients, client_count * sizeof *arr);
     qsort(arr, client_count, sizeof *arr, cmp_client_by_id);
 
-    double *scores = malloc(client_count * sizeof *scores);
-    size_t *score_lengths = malloc(client_count * sizeof *score_lengths);
-    if (!scores || !score_lengths) fatal("Out of memory");
-
+    // Every score fits FIXED7_MAX, so the message can be written in one pass.
+    size_t buflen = binary ? FRAME_HEADER + 4 : strlen("SCORING") + 2;
     for (size_t i = 0; i < client_count; i++) {
-        double sc = calculate_score(n, arr[i]->coeffs, arr[i]->approx, k, arr[i]->penalty);
-        score_lengths[i] = (size_t)snprintf(NULL, 0, "%.7f", sc);
-        scores[i] = sc;
+        buflen += strlen(arr[i]->player_id) + (binary ? 4 + 8 : 2 + FIXED7_MAX);
     }
 
-    size_t buflen = strlen("SCORING") + 1;
-    for (size_t i = 0; i < client_count; i++) {
-        buflen += strlen(arr[i]->player_id) + 1 + score_lengths[i] + 1;
+    MsgBuf *buf = mbAlloc(buflen);
+    char *p = buf->data;
+    if (binary) {
+        p += FRAME_HEADER;
+        put_u32le(p, (uint32_t)client_count);
+        p += 4;
+    }
+    else {
+        memcpy(p, "SCORING", 7);
+        p += 7;
     }
-    buflen += 2 + 1;
-
-    char *buf = malloc(buflen);
-    if (!buf) fatal("Out of memory");
-
-    char *p = buf;
-    int written = snprintf(p, buflen, "SCORING");
-    p += written;
-    buflen -= written;
 
     for (size_t i = 0; i < client_count; i++) {
-        written = snprintf(p, buflen, " %s %.7f",
-                           arr[i]->player_id, scores[i]);
-        p += written;
-        buflen -= written;
+        double sc = clientScore(arr[i]);
+        size_t id_len = strlen(arr[i]->player_id);
+        if (binary) {
+            put_u32le(p, (uint32_t)id_len);
+            memcpy(p + 4, arr[i]->player_id, id_len);
+            put_f64le(p + 4 + id_len, sc);
+            p += 4 + id_len + 8;
+            continue;
+        }
+        *p++ = ' ';
+        memcpy(p, arr[i]->player_id, id_len);
+        p += id_len;
+        *p++ = ' ';
+        p += format_fixed7(p, sc);
     }
 
-    snprintf(p, buflen, "\r\n");
+    if (binary) {
+        put_frame_header(buf->data, FRAME_SCORING, (uint32_t)(p - buf->data - FRAME_HEADER));
+        *p = '\0';
+    }
+    else {
+        memcpy(p, "\r\n", 3);
+        p += 2;
+    }
+    buf->len = p - buf->data;
 
     free(arr);
-    free(scores);
-    free(score_lengths);
     return buf;
 }
\ No newline at end of file
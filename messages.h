@@ -4,33 +4,43 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "cb.h"
 #include "queue.h"
+#include "msgbuf.h"
 #include "client.h"
 
+// Due messages sent with a single writev.
+#define SEND_IOV_MAX 64
+
 bool is_valid_player_id(const char *s);
 size_t count_lowercase(const char *s);
-bool is_valid_bad_put(char *line);
-bool is_valid_state_coeff(char *line);
-bool is_valid_scoring(char *line); 
-bool valid_point_value(char *point_str, char *value_str, size_t *out_point, double *out_value, size_t K);
-bool is_valid_put(const char *line, size_t linelen, char** point, char** value);
+bool is_valid_bad_put(const char *line);
+bool is_valid_state_coeff(const char *line);
+bool is_valid_scoring(const char *line);
+bool valid_point_value(const char *point_str, double point, double value, size_t *out_point, size_t K);
+bool is_valid_put(char *line, size_t linelen, char **point_str, char **value_str,
+    double *point, double *value);
 
-ssize_t send_hello(const char *player_id, EventQueue *q, int fd);
+ssize_t send_hello(const char *player_id, const char *caps, EventQueue *q, int fd);
 ssize_t read_message(CircularBuffer *input_messages, int fd);
 ssize_t process_data_to_send(EventQueue* q, int fd, char* id);
+size_t gather_data_to_send(EventQueue *q, struct iovec *iov, size_t max);
+bool data_sent(EventQueue *q, size_t n, char *id);
+
+double *read_coeffs(const char *payload, size_t *count);
+void queue_msg(EventQueue *q, uint64_t when, bool is_put_response, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+bool is_frame(const char *data);
+const char *frame_name(uint8_t type);
+void queue_point_frame(EventQueue *q, uint64_t when, bool is_put_response, uint8_t type, uint32_t point, double value);
+MsgBuf *create_values_frame(uint8_t type, const double *values, size_t count);
+int get_frame(CircularBuffer *cb, size_t max_len, uint8_t *type, const char **payload, size_t *out_len);
+char *format_values(const char *values, size_t count);
 
-double *read_coeffs(char* payload, size_t *count);
-char *create_penalty_msg(const char *point_str, const char *value_str);
-char *create_badput_msg(const char *point_str, const char *value_str);
-char *create_put_msg(const char *point, const char *value);
-char *create_state_msg(double *approx, size_t K);
-
-bool get_line(CircularBuffer *cb, const char *term, size_t term_len,
-    char **line_ptr, size_t *cap_ptr, size_t *out_len);
-double calculate_score(size_t n, double* coeffs, double* approx, size_t k, size_t penalty);
-double calculate_f(size_t n, double* coeffs, size_t x);
-char *create_scoring_msg(client_t **clients, size_t client_count, size_t n, size_t k) ;
+double calculate_score(const double *f, const double *approx, size_t k, double penalty);
+MsgBuf *create_scoring_msg(client_t **clients, size_t client_count, bool binary);
 
 #endif
\ No newline at end of file
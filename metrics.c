@@ -0,0 +1,123 @@
+#include "metrics.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "common.h"
+
+_Thread_local Metrics *mtLocal = NULL;
+
+static const uint64_t bounds_us[MT_BUCKETS - 1] = {
+    10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 1000000
+};
+
+static const char *kind_names[MT_KINDS] = {
+    [MT_HELLO] = "HELLO",
+    [MT_COEFF] = "COEFF",
+    [MT_PUT] = "PUT",
+    [MT_STATE] = "STATE",
+    [MT_BAD_PUT] = "BAD_PUT",
+    [MT_PENALTY] = "PENALTY",
+    [MT_SCORING] = "SCORING",
+    [MT_INVALID] = "invalid",
+};
+
+void mtObserve(Histogram *h, uint64_t us) {
+    size_t i = 0;
+    while (i < MT_BUCKETS - 1 && us > bounds_us[i]) {
+        i++;
+    }
+    mtAdd(&h->counts[i], 1);
+    mtAdd(&h->sum_us, us);
+}
+
+// A fresh reading, used by the wake-up of an event loop.
+uint64_t mtClock(Metrics *m) {
+    m->clock_us = now_us();
+    m->clock_writes = 0;
+    m->clock_bytes = 0;
+    return m->clock_us;
+}
+
+// The time after a write of the given size, it is behind by at most what the writes since the
+// last reading took.
+uint64_t mtClockAfterWrite(Metrics *m, size_t bytes) {
+    m->clock_bytes += bytes;
+    if (++m->clock_writes > MT_CLOCK_WRITES || m->clock_bytes > MT_CLOCK_BYTES) {
+        return mtClock(m);
+    }
+    return m->clock_us;
+}
+
+static uint64_t load(const _Atomic uint64_t *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+// Sums a counter at the same offset in every thread's Metrics.
+static uint64_t total(Metrics *const *threads, size_t count, size_t offset) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += load((const _Atomic uint64_t *)((const char *)threads[i] + offset));
+    }
+    return sum;
+}
+
+static void write_counter(FILE *out, const char *name, const char *help, uint64_t value) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %" PRIu64 "\n", name, help, name, name, value);
+}
+
+static void write_kinds(FILE *out, const char *name, const char *help, Metrics *const *threads,
+                        size_t count, size_t offset, bool sent) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (size_t k = 0; k < MT_KINDS; k++) {
+        // Neither side sends all kinds, the server only receives HELLO, PUT and garbage.
+        bool possible = sent ? k != MT_HELLO && k != MT_PUT && k != MT_INVALID
+                             : k == MT_HELLO || k == MT_PUT || k == MT_INVALID;
+        if (possible) {
+            fprintf(out, "%s{type=\"%s\"} %" PRIu64 "\n", name, kind_names[k],
+                    total(threads, count, offset + k * sizeof(_Atomic uint64_t)));
+        }
+    }
+}
+
+static void write_histogram(FILE *out, const char *name, const char *help, Metrics *const *threads,
+                            size_t count, size_t offset) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b < MT_BUCKETS; b++) {
+        cumulative += total(threads, count,
+                            offset + offsetof(Histogram, counts) + b * sizeof(_Atomic uint64_t));
+        if (b < MT_BUCKETS - 1) {
+            fprintf(out, "%s_bucket{le=\"%g\"} %" PRIu64 "\n", name, bounds_us[b] / 1e6, cumulative);
+        }
+        else {
+            fprintf(out, "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", name, cumulative);
+        }
+    }
+    uint64_t sum_us = total(threads, count, offset + offsetof(Histogram, sum_us));
+    fprintf(out, "%s_sum %.6f\n%s_count %" PRIu64 "\n", name, sum_us / 1e6, name, cumulative);
+}
+
+// Prometheus text format, every thread's counters added up.
+void mtWrite(FILE *out, Metrics *const *threads, size_t count) {
+    write_counter(out, "approx_connections_accepted_total", "Client connections accepted.",
+                  total(threads, count, offsetof(Metrics, accepted)));
+    write_counter(out, "approx_connections_closed_total", "Client connections closed, by either side.",
+                  total(threads, count, offsetof(Metrics, closed)));
+    write_counter(out, "approx_received_bytes_total", "Bytes read from clients.",
+                  total(threads, count, offsetof(Metrics, bytes_in)));
+    write_counter(out, "approx_sent_bytes_total", "Bytes written to clients.",
+                  total(threads, count, offsetof(Metrics, bytes_out)));
+    write_counter(out, "approx_poll_wakeups_total", "Returns from epoll_wait or io_uring_enter.",
+                  total(threads, count, offsetof(Metrics, wakeups)));
+    write_kinds(out, "approx_messages_received_total", "Messages received, by type.",
+                threads, count, offsetof(Metrics, received), false);
+    write_kinds(out, "approx_messages_sent_total", "Messages completely written, by type.",
+                threads, count, offsetof(Metrics, sent), true);
+    write_histogram(out, "approx_loop_seconds", "Busy time of one event loop iteration.",
+                    threads, count, offsetof(Metrics, loop));
+    write_histogram(out, "approx_send_lag_seconds",
+                    "Time from a message being due, to the millisecond, until it was completely written.",
+                    threads, count, offsetof(Metrics, send_lag));
+}
@@ -0,0 +1,77 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+// Kinds of protocol messages, as sent and received. Binary frames count as their text message,
+// every STATE frame counts as STATE.
+typedef enum {
+    MT_HELLO,
+    MT_COEFF,
+    MT_PUT,
+    MT_STATE,
+    MT_BAD_PUT,
+    MT_PENALTY,
+    MT_SCORING,
+    // A line or frame the receiver rejected.
+    MT_INVALID,
+    MT_KINDS
+} MessageKind;
+
+// Upper bounds of the histogram buckets in microseconds, the last bucket has none.
+#define MT_BUCKETS 15
+
+// A clock reading serves this many writes, or this many bytes written, before it is taken again.
+#define MT_CLOCK_WRITES 16
+#define MT_CLOCK_BYTES (64 << 10)
+
+typedef struct {
+    _Atomic uint64_t counts[MT_BUCKETS];
+    _Atomic uint64_t sum_us;
+} Histogram;
+
+// Counters of one thread. Only the owner writes them, so an update is a plain load and store that
+// never waits for another core; the thread serving /metrics reads them as they are.
+typedef struct {
+    alignas(64) _Atomic uint64_t accepted;
+    _Atomic uint64_t closed;
+    _Atomic uint64_t bytes_in;
+    _Atomic uint64_t bytes_out;
+    _Atomic uint64_t wakeups;
+    _Atomic uint64_t received[MT_KINDS];
+    _Atomic uint64_t sent[MT_KINDS];
+    // Busy time of an event loop iteration, from the wake-up to the next wait.
+    Histogram loop;
+    // From the time an event was due to the moment its last byte was written.
+    Histogram send_lag;
+
+    // Reading the clock for every message would cost more than all the counting, the send lag
+    // is measured with a reading shared by a few writes. Only the owner uses these.
+    uint64_t clock_us;
+    size_t clock_writes;
+    size_t clock_bytes;
+} Metrics;
+
+// Counters of the calling thread, NULL when it records none.
+extern _Thread_local Metrics *mtLocal;
+
+static inline void mtAdd(_Atomic uint64_t *counter, uint64_t n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+// Adds n to a counter of the calling thread, if it records any.
+#define MT_COUNT(field, n) do {                     \
+        Metrics *mt_ = mtLocal;                     \
+        if (mt_) mtAdd(&mt_->field, n);             \
+    } while (0)
+
+void mtObserve(Histogram *h, uint64_t us);
+uint64_t mtClock(Metrics *m);
+uint64_t mtClockAfterWrite(Metrics *m, size_t bytes);
+void mtWrite(FILE *out, Metrics *const *threads, size_t count);
+
+#endif
@@ -0,0 +1,84 @@
+#include "msgbuf.h"
+
+#include <stdlib.h>
+
+#include "err.h"
+
+// Released buffers are kept per thread in power-of-two size classes, 128 B up to 1 MiB
+// (storage including the NUL), and handed out again by mbAlloc.
+#define MB_MIN_SHIFT 7
+#define MB_CLASSES 14
+// Bytes of storage a thread keeps cached per class.
+#define MB_CACHE_BYTES ((size_t)1 << 20)
+
+typedef struct {
+    MsgBuf *head;
+    size_t count;
+} FreeList;
+
+static _Thread_local FreeList cache[MB_CLASSES];
+
+// Smallest class holding size bytes, MB_CLASSES when none does.
+static size_t size_class(size_t size) {
+    size_t cls = 0;
+    while (cls < MB_CLASSES && ((size_t)1 << (cls + MB_MIN_SHIFT)) < size) {
+        cls++;
+    }
+    return cls;
+}
+
+// Room for capacity bytes and the terminating NUL, the caller fills data and sets len.
+MsgBuf *mbAlloc(size_t capacity) {
+    size_t cls = size_class(capacity + 1);
+    MsgBuf *b;
+
+    if (cls < MB_CLASSES && cache[cls].head) {
+        b = cache[cls].head;
+        cache[cls].head = b->next;
+        cache[cls].count--;
+    }
+    else {
+        size_t storage = cls < MB_CLASSES ? (size_t)1 << (cls + MB_MIN_SHIFT) : capacity + 1;
+        b = malloc(sizeof *b + storage);
+        if (!b) fatal("Out of memory");
+        b->capacity = storage - 1;
+    }
+    atomic_init(&b->refs, 1);
+    b->len = 0;
+    b->data[0] = '\0';
+    return b;
+}
+
+MsgBuf *mbRef(MsgBuf *b) {
+    atomic_fetch_add_explicit(&b->refs, 1, memory_order_relaxed);
+    return b;
+}
+
+// The last reference returns the buffer to the releasing thread's cache, or frees it.
+void mbRelease(MsgBuf *b) {
+    if (!b || atomic_fetch_sub_explicit(&b->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    size_t storage = b->capacity + 1;
+    size_t cls = size_class(storage);
+    if (cls < MB_CLASSES && ((size_t)1 << (cls + MB_MIN_SHIFT)) == storage &&
+        (cache[cls].count + 1) * storage <= MB_CACHE_BYTES) {
+        b->next = cache[cls].head;
+        cache[cls].head = b;
+        cache[cls].count++;
+        return;
+    }
+    free(b);
+}
+
+// Frees the calling thread's cached buffers, done before the thread exits.
+void mbCacheFlush(void) {
+    for (size_t cls = 0; cls < MB_CLASSES; cls++) {
+        while (cache[cls].head) {
+            MsgBuf *b = cache[cls].head;
+            cache[cls].head = b->next;
+            free(b);
+        }
+        cache[cls].count = 0;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef MSGBUF_H
+#define MSGBUF_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Reference-counted, NUL-terminated message payload. Queues share it instead of copying.
+// The count is atomic, a buffer may be queued for clients of different workers.
+typedef struct MsgBuf {
+    atomic_size_t refs;
+    size_t len;
+    // Usable bytes of data, not counting the NUL.
+    size_t capacity;
+    // Next free buffer while the buffer sits in a thread's cache.
+    struct MsgBuf *next;
+    char data[];
+} MsgBuf;
+
+MsgBuf *mbAlloc(size_t capacity);
+MsgBuf *mbRef(MsgBuf *b);
+void mbRelease(MsgBuf *b);
+void mbCacheFlush(void);
+
+#endif
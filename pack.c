@@ -0,0 +1,79 @@
+#include "pack.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "wire.h"
+
+size_t pkFrameLen(size_t count) {
+    return FRAME_HEADER + 4 + count * 8;
+}
+
+static const char *entry(const CoeffPack *p, size_t i) {
+    return p->base + PACK_HEADER + i * PACK_ENTRY;
+}
+
+// Every record is checked once here, so pkGet can trust the index and the count in the frame.
+static void check_index(const CoeffPack *p) {
+    if (PACK_HEADER + p->count * PACK_ENTRY > p->size) {
+        fatal("Coefficient pack is truncated");
+    }
+    for (size_t i = 0; i < p->count; i++) {
+        const char *e = entry(p, i);
+        uint64_t offset = get_u64le(e);
+        uint32_t count = get_u32le(e + 8);
+        size_t frame_len = pkFrameLen(count);
+        size_t line_len = get_u32le(e + 12);
+
+        if (offset > p->size || p->size - offset < frame_len + line_len + 1 ||
+            p->base[offset] != FRAME_COEFF || get_u32le(p->base + offset + 1) != frame_len - FRAME_HEADER ||
+            get_u32le(p->base + offset + FRAME_HEADER) != count ||
+            p->base[offset + frame_len + line_len] != '\0') {
+            fatal("Coefficient pack has a bad record %zu", i);
+        }
+    }
+}
+
+// Maps the file when it is a pack. Returns false, leaving the file as it was, when it is not.
+bool pkOpen(CoeffPack *p, int fd) {
+    char header[PACK_HEADER];
+    ssize_t n = pread(fd, header, sizeof header, 0);
+    if (n < PACK_HEADER || memcmp(header, PACK_MAGIC, PACK_MAGIC_LEN) != 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        syserr("fstat");
+    }
+    p->size = (size_t)st.st_size;
+    p->count = get_u32le(header + PACK_MAGIC_LEN);
+    p->base = mmap(NULL, p->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p->base == MAP_FAILED) {
+        syserr("mmap");
+    }
+    check_index(p);
+    return true;
+}
+
+void pkClose(CoeffPack *p) {
+    munmap((void *)p->base, p->size);
+    p->base = NULL;
+    p->size = p->count = 0;
+}
+
+PackLine pkGet(const CoeffPack *p, size_t i) {
+    const char *e = entry(p, i);
+    uint64_t offset = get_u64le(e);
+    PackLine line;
+    line.count = get_u32le(e + 8);
+    line.frame = p->base + offset;
+    line.frame_len = pkFrameLen(line.count);
+    line.line = line.frame + line.frame_len;
+    line.line_len = get_u32le(e + 12);
+    return line;
+}
@@ -0,0 +1,37 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Coefficient pack written by approx-coeffpack and mapped by the server. Integers are little-endian.
+//   header   magic "APXPACK1", uint32 line count, uint32 zero
+//   index    per line: uint64 record offset, uint32 value count, uint32 text length
+//   records  per line: the COEFF frame of wire.h, then the COEFF text line as read and a NUL
+#define PACK_MAGIC "APXPACK1"
+#define PACK_MAGIC_LEN 8
+#define PACK_HEADER 16
+#define PACK_ENTRY 16
+
+typedef struct {
+    const char *base;
+    size_t size;
+    size_t count;
+} CoeffPack;
+
+// One line of a pack, pointing into the mapping.
+typedef struct {
+    const char *frame;
+    size_t frame_len;
+    const char *line;
+    size_t line_len;
+    size_t count;
+} PackLine;
+
+bool pkOpen(CoeffPack *p, int fd);
+void pkClose(CoeffPack *p);
+PackLine pkGet(const CoeffPack *p, size_t i);
+size_t pkFrameLen(size_t count);
+
+#endif
@@ -0,0 +1,76 @@
+#include "poly.h"
+
+#include <string.h>
+
+#include "common.h"
+
+// Consecutive points are evaluated side by side, as wide as the variant's registers: four with
+// AVX2, two otherwise (SSE2 on x86-64, or whatever GCC makes of it elsewhere).
+typedef double v2d __attribute__((vector_size(16)));
+typedef double v4d __attribute__((vector_size(32)));
+
+// Horner's scheme, inlined into a copy per degree so the inner loop is fully unrolled. No fused
+// multiply-add is allowed to creep in, every variant computes bit-identical values: the AVX2 copy
+// excludes FMA and the Makefile builds this file with -ffp-contract=off for every target.
+#define DEFINE_FILL_DEGREE(name, vec, width)                                                \
+    static inline __attribute__((always_inline))                                            \
+    void name(const double *coeffs, size_t degree, double *out, size_t from, size_t to) {  \
+        size_t x = from;                                                                    \
+        vec xs;                                                                             \
+        for (size_t j = 0; j < width; j++) {                                                \
+            xs[j] = (double)(x + j);                                                        \
+        }                                                                                   \
+        for (; x + width <= to; x += width) {                                               \
+            vec fx = (vec){0} + coeffs[degree];                                             \
+            for (size_t i = degree; i-- > 0;) {                                             \
+                fx = fx * xs + coeffs[i];                                                   \
+            }                                                                               \
+            memcpy(out + (x - from), &fx, sizeof fx);                                       \
+            xs += (double)width;                                                            \
+        }                                                                                   \
+        for (; x < to; x++) {                                                               \
+            double fx = coeffs[degree];                                                     \
+            for (size_t i = degree; i-- > 0;) {                                             \
+                fx = fx * (double)x + coeffs[i];                                            \
+            }                                                                               \
+            out[x - from] = fx;                                                             \
+        }                                                                                   \
+    }
+
+#define FILL_CASE(fill, d) case d: fill(coeffs, d, out, from, to); return;
+
+#define DEFINE_FILL(name, fill, attr)                                                       \
+    static attr void name(const double *coeffs, size_t degree, double *out, size_t from,   \
+                          size_t to) {                                                      \
+        switch (degree) {                                                                   \
+            FILL_CASE(fill, 0) FILL_CASE(fill, 1) FILL_CASE(fill, 2) FILL_CASE(fill, 3)     \
+            FILL_CASE(fill, 4) FILL_CASE(fill, 5) FILL_CASE(fill, 6) FILL_CASE(fill, 7)     \
+            FILL_CASE(fill, 8)                                                              \
+        }                                                                                   \
+        fill(coeffs, degree, out, from, to);                                                \
+    }
+
+_Static_assert(MAX_N == 8, "fill variants cover degrees up to MAX_N");
+
+DEFINE_FILL_DEGREE(fill_degree2, v2d, 2)
+DEFINE_FILL(fill_generic, fill_degree2, )
+#if defined(__x86_64__) || defined(__i386__)
+DEFINE_FILL_DEGREE(fill_degree4, v4d, 4)
+DEFINE_FILL(fill_avx2, fill_degree4, __attribute__((target("avx2,no-fma"))))
+#endif
+
+// Writes f(x) for every x in [from, to) to out[x - from]. f has count coefficients, lowest first,
+// no coefficients at all is the zero polynomial.
+void pfFill(const double *coeffs, size_t count, double *out, size_t from, size_t to) {
+    if (count == 0) {
+        memset(out, 0, (to - from) * sizeof *out);
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        fill_avx2(coeffs, count - 1, out, from, to);
+        return;
+    }
+#endif
+    fill_generic(coeffs, count - 1, out, from, to);
+}
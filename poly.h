@@ -0,0 +1,8 @@
+#ifndef POLY_H
+#define POLY_H
+
+#include <stddef.h>
+
+void pfFill(const double *coeffs, size_t count, double *out, size_t from, size_t to);
+
+#endif
@@ -0,0 +1,102 @@
+#include "put.h"
+
+#include <math.h>
+
+#include "common.h"
+#include "messages.h"
+#include "queue.h"
+#include "state.h"
+#include "wire.h"
+
+// Counts a valid PUT against the shared limit, returns false once the game is already complete.
+static bool count_put(PutGame *g) {
+    size_t total = atomic_load(&g->puts);
+    do {
+        if (total >= g->m) {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak(&g->puts, &total, total + 1));
+
+    if (total + 1 == g->m) {
+        g->on_complete();
+    }
+    return true;
+}
+
+// A PUT before the previous answer or before COEFF went out is penalized.
+static bool put_too_early(client_t *c) {
+    return !eqLastPutSend(&c->q) || !c->send_coeffs;
+}
+
+// Recomputes the error from scratch, which also drops what rounding the updates accumulated.
+void exact_error(client_t *c, size_t k) {
+    c->error = calculate_score(c->f, c->approx, k, 0);
+    c->error_comp = 0;
+    c->error_puts = 0;
+}
+
+// A PUT changes one term of the error: a^2 - b^2 = (a - b)(a + b). Neumaier's compensation keeps
+// the running sum as accurate as a fresh one, the periodic recomputation bounds the rest.
+static void update_error(client_t *c, size_t point, double before, size_t k) {
+    double after = c->approx[point] - c->f[point];
+    double delta = (after - before) * (after + before);
+
+    double sum = c->error + delta;
+    if (fabs(c->error) >= fabs(delta)) {
+        c->error_comp += (c->error - sum) + delta;
+    }
+    else {
+        c->error_comp += (delta - sum) + c->error;
+    }
+    c->error = sum;
+
+    if (++c->error_puts > k) {
+        exact_error(c, k);
+    }
+}
+
+static void accept_put(PutGame *g, client_t *c, size_t point, double value, uint64_t now) {
+    if (count_put(g)) {
+        double before = c->approx[point] - c->f[point];
+        c->approx[point] += value;
+        c->put_send++;
+        update_error(c, point, before, g->k);
+
+        eqPush(&c->q, now + c->delay, slUpdate(&c->state, c->approx, point), true);
+    }
+}
+
+void process_put(PutGame *g, client_t *c, char *point_str, char *value_str, double parsed_point,
+                 double value) {
+    size_t point;
+    uint64_t now = now_ms();
+
+    if (put_too_early(c)) {
+        queue_msg(&c->q, now, false, "PENALTY %s %s\r\n", point_str, value_str);
+        c->penalty += 20;
+    }
+    if (!valid_point_value(point_str, parsed_point, value, &point, g->k)) {
+        queue_msg(&c->q, now + 1000, true, "BAD_PUT %s %s\r\n", point_str, value_str);
+        c->penalty += 10;
+    }
+    else {
+        accept_put(g, c, point, value, now);
+    }
+}
+
+// Binary PUT: the point and value need no parsing, only the range checks remain.
+void process_put_frame(PutGame *g, client_t *c, uint32_t point, double value) {
+    uint64_t now = now_ms();
+
+    if (put_too_early(c)) {
+        queue_point_frame(&c->q, now, false, FRAME_PENALTY, point, value);
+        c->penalty += 20;
+    }
+    if (point > g->k || !(value >= -5.0 && value <= 5.0)) {
+        queue_point_frame(&c->q, now + 1000, true, FRAME_BAD_PUT, point, value);
+        c->penalty += 10;
+    }
+    else {
+        accept_put(g, c, point, value, now);
+    }
+}
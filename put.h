@@ -0,0 +1,25 @@
+#ifndef PUT_H
+#define PUT_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "client.h"
+
+// The game as PUTs see it, shared by every worker.
+typedef struct {
+    size_t k;
+    size_t m;
+    // Valid PUTs counted in the current game, over all clients.
+    atomic_size_t puts;
+    // Called by the worker whose PUT completes the game.
+    void (*on_complete)(void);
+} PutGame;
+
+void process_put(PutGame *g, client_t *c, char *point_str, char *value_str, double parsed_point,
+                 double value);
+void process_put_frame(PutGame *g, client_t *c, uint32_t point, double value);
+void exact_error(client_t *c, size_t k);
+
+#endif
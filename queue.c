@@ -6,15 +6,58 @@
 #include <stdint.h>
 #include "err.h"
 
-static void swap_events(ScheduledEvent *a, ScheduledEvent *b, size_t idx_a, size_t idx_b, EventQueue *q) {
+#define READY_INITIAL 8
+
+static void swap_events(ScheduledEvent *a, ScheduledEvent *b) {
     ScheduledEvent tmp = *a;
     *a = *b;
     *b = tmp;
+}
+
+static bool earlier(const ScheduledEvent *a, const ScheduledEvent *b) {
+    return a->send_time < b->send_time || (a->send_time == b->send_time && a->id < b->id);
+}
+
+// Removes the heap top without releasing its message.
+static void heap_remove_top(EventQueue *q) {
+    q->heap[0] = q->heap[--q->size];
+
+    size_t idx = 0;
+    while (true) {
+        size_t left = 2 * idx + 1;
+        size_t right = left + 1;
+        size_t smallest = idx;
+
+        if (left < q->size && earlier(&q->heap[left], &q->heap[smallest])) {
+            smallest = left;
+        }
+        if (right < q->size && earlier(&q->heap[right], &q->heap[smallest])) {
+            smallest = right;
+        }
+
+        if (smallest == idx)
+            break;
+
+        swap_events(&q->heap[idx], &q->heap[smallest]);
+        idx = smallest;
+    }
+}
 
-    if (q->last_put_idx == idx_a)
-        q->last_put_idx = idx_b;
-    else if (q->last_put_idx == idx_b)
-        q->last_put_idx = idx_a;
+// The ready list is a ring, its capacity stays a power of two.
+static void ready_push(EventQueue *q, ScheduledEvent evt) {
+    if (q->ready_count == q->ready_capacity) {
+        size_t new_cap = q->ready_capacity ? q->ready_capacity * 2 : READY_INITIAL;
+        ScheduledEvent *tmp = malloc(new_cap * sizeof *tmp);
+        if (!tmp) fatal("Out of memory");
+        for (size_t i = 0; i < q->ready_count; ++i) {
+            tmp[i] = *eqReady(q, i);
+        }
+        free(q->ready);
+        q->ready = tmp;
+        q->ready_head = 0;
+        q->ready_capacity = new_cap;
+    }
+    q->ready[(q->ready_head + q->ready_count++) & (q->ready_capacity - 1)] = evt;
 }
 
 void eqInit(EventQueue *q) {
@@ -22,25 +65,39 @@ void eqInit(EventQueue *q) {
     if (!q->heap) fatal("Out of memory");
     q->size = 0;
     q->capacity = 8;
-    q->last_put_idx = SIZE_MAX;
+    q->last_put_id = SIZE_MAX;
     q->next_id = 0;
+    q->bytes = 0;
+    q->ready = NULL;
+    q->ready_head = q->ready_count = q->ready_capacity = 0;
 }
 
 void eqDestroy(EventQueue *q) {
     for (size_t i = 0; i < q->size; ++i) {
-        free(q->heap[i].msg);
+        mbRelease(q->heap[i].msg);
+    }
+    for (size_t i = 0; i < q->ready_count; ++i) {
+        mbRelease(eqReady(q, i)->msg);
     }
     free(q->heap);
+    free(q->ready);
     q->heap = NULL;
+    q->ready = NULL;
     q->size = q->capacity = 0;
-    q->last_put_idx = SIZE_MAX;
+    q->ready_head = q->ready_count = q->ready_capacity = 0;
+    q->last_put_id = SIZE_MAX;
+    q->bytes = 0;
 }
 
 bool eqEmpty(const EventQueue *q) {
-    return q->size == 0;
+    return q->size == 0 && q->ready_count == 0;
+}
+
+size_t eqBytes(const EventQueue *q) {
+    return q->bytes;
 }
 
-void eqPush(EventQueue *q, uint64_t when, const char *msg, bool is_put_response) {
+static ScheduledEvent *heap_append(EventQueue *q, uint64_t when) {
     if (q->size + 1 > q->capacity) {
         size_t new_cap = q->capacity * 2;
         ScheduledEvent *tmp = realloc(q->heap, new_cap * sizeof *tmp);
@@ -52,86 +109,133 @@ void eqPush(EventQueue *q, uint64_t when, const char *msg, bool is_put_response)
     ScheduledEvent *evt = &q->heap[q->size];
     evt->send_time = when;
     evt->id = q->next_id++;
-    evt->msg = strdup(msg);
-    if (!evt->msg) fatal("Out of memory");
-    evt->ptr = evt->msg;
-    evt->remaining = strlen(evt->msg);
+    evt->sent = 0;
+    evt->msg = NULL;
+    evt->static_data = NULL;
+    return evt;
+}
+
+// Adds the event prepared by heap_append to the heap.
+static void heap_commit(EventQueue *q, bool is_put_response) {
+    ScheduledEvent *evt = &q->heap[q->size];
+    if (is_put_response) {
+        q->last_put_id = evt->id;
+    }
 
     size_t idx = q->size++;
     while (idx > 0) {
         size_t parent = (idx - 1) / 2;
-        bool need_swap = false;
-        if (q->heap[parent].send_time > q->heap[idx].send_time) {
-            need_swap = true;
-        } else if (q->heap[parent].send_time == q->heap[idx].send_time &&
-                   q->heap[parent].id > q->heap[idx].id) {
-            need_swap = true;
-        }
-
-        if (!need_swap)
+        if (!earlier(&q->heap[idx], &q->heap[parent]))
             break;
 
-        swap_events(&q->heap[parent], &q->heap[idx], parent, idx, q);
+        swap_events(&q->heap[parent], &q->heap[idx]);
         idx = parent;
     }
+}
 
-    if (is_put_response) {
-        q->last_put_idx = idx;
+// Takes over the caller's reference to msg.
+void eqPush(EventQueue *q, uint64_t when, MsgBuf *msg, bool is_put_response) {
+    ScheduledEvent *evt = heap_append(q, when);
+    evt->msg = msg;
+    evt->remaining = msg->len;
+    q->bytes += msg->len;
+    heap_commit(q, is_put_response);
+}
+
+// Copies a short payload into the event, longer ones go to a MsgBuf.
+void eqPushInline(EventQueue *q, uint64_t when, const char *data, size_t len, bool is_put_response) {
+    if (len > EQ_INLINE_SIZE) {
+        MsgBuf *msg = mbAlloc(len);
+        memcpy(msg->data, data, len);
+        msg->data[len] = '\0';
+        msg->len = len;
+        eqPush(q, when, msg, is_put_response);
+        return;
+    }
+    ScheduledEvent *evt = heap_append(q, when);
+    memcpy(evt->inline_data, data, len);
+    evt->inline_data[len] = '\0';
+    evt->remaining = len;
+    q->bytes += len;
+    heap_commit(q, is_put_response);
+}
+
+// Neither copied nor released, data must stay valid until the server exits.
+void eqPushStatic(EventQueue *q, uint64_t when, const char *data, size_t len, bool is_put_response) {
+    ScheduledEvent *evt = heap_append(q, when);
+    evt->static_data = data;
+    evt->remaining = len;
+    q->bytes += len;
+    heap_commit(q, is_put_response);
+}
+
+// Start of the whole payload, including the part already sent.
+const char *eqData(const ScheduledEvent *evt) {
+    if (evt->msg) {
+        return evt->msg->data;
     }
+    return evt->static_data ? evt->static_data : evt->inline_data;
 }
 
+// Accounts n bytes written from the event that is sent next.
 void eqUpdate(EventQueue *q, size_t n) {
-    if (q->size == 0) return;
-    q->heap[0].ptr += n;
-    q->heap[0].remaining -= n;
+    ScheduledEvent *evt = eqPeek(q);
+    if (!evt) return;
+    evt->sent += n;
+    evt->remaining -= n;
+    q->bytes -= n;
 }
 
+// The event that is sent next: the oldest ready one, otherwise the heap top.
 ScheduledEvent *eqPeek(const EventQueue *q) {
+    if (q->ready_count > 0) return eqReady(q, 0);
     if (q->size == 0) return NULL;
     return &q->heap[0];
 }
 
 void eqPop(EventQueue *q) {
-    if (q->size == 0) return;
-    if (q->last_put_idx == 0) {
-        q->last_put_idx = SIZE_MAX;
+    ScheduledEvent *evt = eqPeek(q);
+    if (!evt) return;
+    if (evt->id == q->last_put_id) {
+        q->last_put_id = SIZE_MAX;
     }
+    q->bytes -= evt->remaining;
+    mbRelease(evt->msg);
 
-    free(q->heap[0].msg);
-    q->heap[0] = q->heap[--q->size];
-    if (q->last_put_idx == q->size) {
-        q->last_put_idx = 0;
+    if (q->ready_count > 0) {
+        q->ready_head = (q->ready_head + 1) & (q->ready_capacity - 1);
+        q->ready_count--;
     }
+    else {
+        heap_remove_top(q);
+    }
+}
 
-    size_t idx = 0;
-    while (true) {
-        size_t left = 2 * idx + 1;
-        size_t right = left + 1;
-        size_t smallest = idx;
-
-        if (left < q->size) {
-            if (q->heap[left].send_time < q->heap[smallest].send_time ||
-                (q->heap[left].send_time == q->heap[smallest].send_time &&
-                 q->heap[left].id < q->heap[smallest].id)) {
-                smallest = left;
-            }
-        }
-        if (right < q->size) {
-            if (q->heap[right].send_time < q->heap[smallest].send_time ||
-                (q->heap[right].send_time == q->heap[smallest].send_time &&
-                 q->heap[right].id < q->heap[smallest].id)) {
-                smallest = right;
-            }
-        }
+bool eqLastPutSend(EventQueue *q) {
+    return (q->last_put_id == SIZE_MAX);
+}
 
-        if (smallest == idx)
-            break;
+// Moves every event due at now to the ready list, returns how many events are ready.
+// Anything pushed later is due no earlier, so ready events always go out first.
+size_t eqCollectDue(EventQueue *q, uint64_t now) {
+    while (q->size > 0 && q->heap[0].send_time <= now) {
+        ready_push(q, q->heap[0]);
+        heap_remove_top(q);
+    }
+    return q->ready_count;
+}
 
-        swap_events(&q->heap[idx], &q->heap[smallest], idx, smallest, q);
-        idx = smallest;
+// Describes the unsent bytes of up to max ready events, returns the number of iovecs filled.
+size_t eqReadyIov(const EventQueue *q, struct iovec *iov, size_t max) {
+    size_t count = q->ready_count < max ? q->ready_count : max;
+    for (size_t i = 0; i < count; ++i) {
+        ScheduledEvent *evt = eqReady(q, i);
+        iov[i].iov_base = (void *)(eqData(evt) + evt->sent);
+        iov[i].iov_len = evt->remaining;
     }
+    return count;
 }
 
-bool eqLastPutSend(EventQueue *q) {
-    return (q->last_put_idx == SIZE_MAX);
+ScheduledEvent *eqReady(const EventQueue *q, size_t i) {
+    return &q->ready[(q->ready_head + i) & (q->ready_capacity - 1)];
 }
@@ -5,29 +5,55 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/uio.h>
+
+#include "msgbuf.h"
+
+// Payloads up to this many bytes are stored in the event itself.
+#define EQ_INLINE_SIZE 63
 
 typedef struct {
     uint64_t send_time;
-    char *msg;
-    char *ptr;
+    // NULL when the payload is stored inline or outside the queue.
+    MsgBuf *msg;
+    // Payload that outlives every queue, such as a line of a mapped coefficient pack.
+    const char *static_data;
+    size_t sent;
     size_t remaining;
     size_t id;
+    char inline_data[EQ_INLINE_SIZE + 1];
 } ScheduledEvent;
 
 typedef struct {
     ScheduledEvent *heap;
     size_t size;
     size_t capacity;
-    size_t last_put_idx;
+    size_t last_put_id;
     size_t next_id;
+    // Bytes of all events that are still to be sent.
+    size_t bytes;
+
+    // Due events taken out of the heap in sending order, the first one may be partially written.
+    ScheduledEvent *ready;
+    size_t ready_head;
+    size_t ready_count;
+    size_t ready_capacity;
 } EventQueue;
 
 void eqInit(EventQueue *q);
 void eqDestroy(EventQueue *q);
 bool eqEmpty(const EventQueue *q);
-void eqPush(EventQueue *q, uint64_t when, const char *msg, bool is_put_response);
+size_t eqBytes(const EventQueue *q);
+void eqPush(EventQueue *q, uint64_t when, MsgBuf *msg, bool is_put_response);
+void eqPushInline(EventQueue *q, uint64_t when, const char *data, size_t len, bool is_put_response);
+void eqPushStatic(EventQueue *q, uint64_t when, const char *data, size_t len, bool is_put_response);
+const char *eqData(const ScheduledEvent *evt);
+void eqUpdate(EventQueue *q, size_t n);
 ScheduledEvent *eqPeek(const EventQueue *q);
 void eqPop(EventQueue *q);
 bool eqLastPutSend(EventQueue *q);
+size_t eqCollectDue(EventQueue *q, uint64_t now);
+size_t eqReadyIov(const EventQueue *q, struct iovec *iov, size_t max);
+ScheduledEvent *eqReady(const EventQueue *q, size_t i);
 
 #endif
\ No newline at end of file
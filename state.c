@@ -0,0 +1,167 @@
+#include "state.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "err.h"
+#include "fixed.h"
+#include "messages.h"
+#include "wire.h"
+
+// Offset of the first value in a STATE frame.
+#define FRAME_VALUES (FRAME_HEADER + 4)
+#define DELTA_LEN (FRAME_HEADER + FRAME_PAIRS + FRAME_POINT_VALUE)
+
+// Makes the line private and big enough for len bytes. A line still queued is copied, not modified.
+static void reserve(StateLine *s, size_t len) {
+    MsgBuf *old = s->line;
+    if (atomic_load(&old->refs) == 1 && old->capacity >= len) {
+        return;
+    }
+    size_t capacity = old->capacity > len ? old->capacity : len + len / 8;
+    MsgBuf *b = mbAlloc(capacity);
+    memcpy(b->data, old->data, old->len + 1);
+    b->len = old->len;
+    mbRelease(old);
+    s->line = b;
+}
+
+static void build(StateLine *s, const double *approx) {
+    if (s->binary) {
+        s->line = create_values_frame(FRAME_STATE, approx, s->k + 1);
+        return;
+    }
+
+    char text[FIXED7_MAX];
+    s->line = mbAlloc(6 + (s->k + 1) * 11 + 2);
+    memcpy(s->line->data, "STATE", 5);
+    s->line->len = 5;
+
+    for (size_t i = 0; i <= s->k; ++i) {
+        size_t n = format_fixed7(text, approx[i]);
+        reserve(s, s->line->len + 1 + n + 2);
+        char *d = s->line->data;
+        d[s->line->len++] = ' ';
+        s->offsets[i] = s->line->len;
+        memcpy(d + s->line->len, text, n);
+        s->line->len += n;
+    }
+    memcpy(s->line->data + s->line->len, "\r\n", 3);
+    s->line->len += 2;
+}
+
+void slInit(StateLine *s, size_t k) {
+    s->line = NULL;
+    s->k = k;
+    s->binary = false;
+    s->delta = false;
+    s->synced = false;
+    s->delta_bytes = 0;
+    s->offsets = malloc((k + 1) * sizeof *s->offsets);
+    if (!s->offsets) fatal("Out of memory");
+}
+
+// Must be chosen before the first update.
+void slUseBinary(StateLine *s) {
+    s->binary = true;
+}
+
+// Binary clients that can rebuild the state from point lists. Must be chosen before the first update.
+void slUseDelta(StateLine *s) {
+    s->binary = true;
+    s->delta = true;
+}
+
+void slDestroy(StateLine *s) {
+    mbRelease(s->line);
+    free(s->offsets);
+    s->line = NULL;
+    s->offsets = NULL;
+}
+
+static void put_pairs_header(char *p, uint8_t type, size_t values, size_t pairs) {
+    put_frame_header(p, type, (uint32_t)(FRAME_PAIRS + pairs * FRAME_POINT_VALUE));
+    put_u32le(p + FRAME_HEADER, (uint32_t)values);
+    put_u32le(p + FRAME_HEADER + 4, (uint32_t)pairs);
+}
+
+// The whole state as a sparse or a dense frame, whichever is shorter.
+static MsgBuf *full_state(StateLine *s, const double *approx) {
+    size_t nonzero = 0;
+    for (size_t i = 0; i <= s->k; ++i) {
+        nonzero += approx[i] != 0;
+    }
+    s->synced = true;
+    s->delta_bytes = 0;
+
+    if (FRAME_PAIRS + nonzero * FRAME_POINT_VALUE >= 4 + (s->k + 1) * 8) {
+        return create_values_frame(FRAME_STATE, approx, s->k + 1);
+    }
+    MsgBuf *b = mbAlloc(FRAME_HEADER + FRAME_PAIRS + nonzero * FRAME_POINT_VALUE);
+    put_pairs_header(b->data, FRAME_STATE_SPARSE, s->k + 1, nonzero);
+    char *p = b->data + FRAME_HEADER + FRAME_PAIRS;
+    for (size_t i = 0; i <= s->k; ++i) {
+        if (approx[i] != 0) {
+            put_u32le(p, (uint32_t)i);
+            put_f64le(p + 4, approx[i]);
+            p += FRAME_POINT_VALUE;
+        }
+    }
+    b->len = (size_t)(p - b->data);
+    b->data[b->len] = '\0';
+    return b;
+}
+
+// STATE messages of a client all wait the same delay, so they leave in the order they are made
+// and the previous one is exactly what the client holds when a delta arrives. Every PUT changes
+// one point, so a delta is a single pair. Once the deltas add up to the size of a dense state
+// the client is resynchronized, which keeps the amortized cost per PUT constant.
+static MsgBuf *delta_state(StateLine *s, const double *approx, size_t point) {
+    if (!s->synced || s->delta_bytes >= FRAME_HEADER + 4 + (s->k + 1) * 8) {
+        return full_state(s, approx);
+    }
+    MsgBuf *b = mbAlloc(DELTA_LEN);
+    put_pairs_header(b->data, FRAME_STATE_DELTA, s->k + 1, 1);
+    put_u32le(b->data + FRAME_HEADER + FRAME_PAIRS, (uint32_t)point);
+    put_f64le(b->data + FRAME_HEADER + FRAME_PAIRS + 4, approx[point]);
+    b->len = DELTA_LEN;
+    b->data[b->len] = '\0';
+    s->delta_bytes += DELTA_LEN;
+    return b;
+}
+
+// Reformats only approx[point] and returns a new reference to the whole line.
+MsgBuf *slUpdate(StateLine *s, const double *approx, size_t point) {
+    if (s->delta) {
+        return delta_state(s, approx, point);
+    }
+    if (!s->line) {
+        build(s, approx);
+        return mbRef(s->line);
+    }
+
+    if (s->binary) {
+        reserve(s, s->line->len);
+        put_f64le(s->line->data + FRAME_VALUES + point * 8, approx[point]);
+        return mbRef(s->line);
+    }
+
+    char text[FIXED7_MAX];
+    size_t n = format_fixed7(text, approx[point]);
+    size_t start = s->offsets[point];
+    size_t end = point < s->k ? s->offsets[point + 1] - 1 : s->line->len - 2;
+    size_t len = s->line->len - (end - start) + n;
+
+    reserve(s, len);
+    char *d = s->line->data;
+    if (n != end - start) {
+        // Moves the tail including the NUL, the later values shift by the same amount.
+        memmove(d + start + n, d + end, s->line->len - end + 1);
+        for (size_t i = point + 1; i <= s->k; ++i) {
+            s->offsets[i] = s->offsets[i] + n - (end - start);
+        }
+    }
+    memcpy(d + start, text, n);
+    s->line->len = len;
+    return mbRef(s->line);
+}
@@ -0,0 +1,31 @@
+#ifndef STATE_LINE_H
+#define STATE_LINE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "msgbuf.h"
+
+// Serialized STATE line (or STATE frame for binary clients) of one client,
+// patched in place when a single point changes.
+typedef struct {
+    // Built on the first update. Queued STATE messages share it until it changes again.
+    MsgBuf *line;
+    // Where each value starts within the line.
+    size_t *offsets;
+    size_t k;
+    bool binary;
+    // Delta clients get full states only now and then, line stays NULL for them.
+    bool delta;
+    bool synced;
+    // Sent in deltas since the last full state.
+    size_t delta_bytes;
+} StateLine;
+
+void slInit(StateLine *s, size_t k);
+void slUseBinary(StateLine *s);
+void slUseDelta(StateLine *s);
+void slDestroy(StateLine *s);
+MsgBuf *slUpdate(StateLine *s, const double *approx, size_t point);
+
+#endif
@@ -0,0 +1,461 @@
+#define _GNU_SOURCE
+#include "status.h"
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "err.h"
+#include "fixed.h"
+#include "logger.h"
+
+// Longest request head read, headers included. A reader gets its answer within ST_TIMEOUT ms.
+#define ST_REQUEST_MAX 4096
+#define ST_TIMEOUT 2000
+
+static void *grow(void *data, size_t *capacity, size_t needed, size_t size) {
+    if (needed <= *capacity) {
+        return data;
+    }
+    size_t new_cap = *capacity ? *capacity : 64;
+    while (new_cap < needed) {
+        new_cap *= 2;
+    }
+    void *tmp = realloc(data, new_cap * size);
+    if (!tmp) fatal("Out of memory");
+    *capacity = new_cap;
+    return tmp;
+}
+
+void stClear(StatusTable *t) {
+    t->count = 0;
+    t->ids_len = 0;
+}
+
+void stAdd(StatusTable *t, const char *id, size_t puts, double penalty, double score) {
+    size_t id_len = strlen(id) + 1;
+    t->players = grow(t->players, &t->capacity, t->count + 1, sizeof *t->players);
+    t->ids = grow(t->ids, &t->ids_capacity, t->ids_len + id_len, 1);
+    memcpy(t->ids + t->ids_len, id, id_len);
+    t->players[t->count++] = (StatusPlayer) {
+        .id = t->ids_len, .puts = puts, .penalty = penalty, .score = score
+    };
+    t->ids_len += id_len;
+}
+
+void stAppend(StatusTable *dst, const StatusTable *src) {
+    if (src->count == 0) {
+        return;
+    }
+    dst->players = grow(dst->players, &dst->capacity, dst->count + src->count, sizeof *dst->players);
+    dst->ids = grow(dst->ids, &dst->ids_capacity, dst->ids_len + src->ids_len, 1);
+    for (size_t i = 0; i < src->count; i++) {
+        dst->players[dst->count + i] = src->players[i];
+        dst->players[dst->count + i].id += dst->ids_len;
+    }
+    memcpy(dst->ids + dst->ids_len, src->ids, src->ids_len);
+    dst->count += src->count;
+    dst->ids_len += src->ids_len;
+}
+
+void stFree(StatusTable *t) {
+    free(t->players);
+    free(t->ids);
+    *t = (StatusTable) {0};
+}
+
+void stBoardInit(StatusBoard *b) {
+    pthread_mutex_init(&b->lock, NULL);
+    b->rows = NULL;
+    b->count = b->capacity = 0;
+}
+
+// Returns the row of the new player, it has no PUTs and no score yet.
+size_t stBoardAdd(StatusBoard *b, const char *id, uint64_t owner) {
+    pthread_mutex_lock(&b->lock);
+    b->rows = grow(b->rows, &b->capacity, b->count + 1, sizeof *b->rows);
+    size_t row = b->count++;
+    b->rows[row] = (StatusRow) { .id = id, .owner = owner };
+    pthread_mutex_unlock(&b->lock);
+    return row;
+}
+
+// The last row takes the place of the removed one. Returns true and its owner in moved when a
+// row moved.
+bool stBoardRemove(StatusBoard *b, size_t row, uint64_t *moved) {
+    pthread_mutex_lock(&b->lock);
+    bool last = row == --b->count;
+    if (!last) {
+        b->rows[row] = b->rows[b->count];
+        *moved = b->rows[row].owner;
+    }
+    pthread_mutex_unlock(&b->lock);
+    return !last;
+}
+
+void stBoardSet(StatusBoard *b, size_t row, size_t puts, double penalty, double score) {
+    pthread_mutex_lock(&b->lock);
+    b->rows[row].puts = puts;
+    b->rows[row].penalty = penalty;
+    b->rows[row].score = score;
+    pthread_mutex_unlock(&b->lock);
+}
+
+// Appends the board's players to dst.
+void stBoardCopy(StatusTable *dst, StatusBoard *b) {
+    pthread_mutex_lock(&b->lock);
+    for (size_t i = 0; i < b->count; i++) {
+        const StatusRow *r = &b->rows[i];
+        stAdd(dst, r->id, r->puts, r->penalty, r->score);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+void stBoardFree(StatusBoard *b) {
+    free(b->rows);
+    b->rows = NULL;
+    b->count = b->capacity = 0;
+    pthread_mutex_destroy(&b->lock);
+}
+
+// Leaderboard order: lowest score first, ties by id.
+static int by_score(const void *a, const void *b, void *ids) {
+    const StatusPlayer *pa = a, *pb = b;
+    if (pa->score != pb->score) {
+        return pa->score < pb->score ? -1 : 1;
+    }
+    return strcmp((char *)ids + pa->id, (char *)ids + pb->id);
+}
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+} Text;
+
+static void text_printf(Text *t, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void text_printf(Text *t, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    size_t room = t->capacity - t->len;
+    int n = vsnprintf(t->data ? t->data + t->len : NULL, room, fmt, args);
+    va_end(args);
+    if (n < 0) fatal("vsnprintf");
+
+    if ((size_t)n >= room) {
+        t->data = grow(t->data, &t->capacity, t->len + (size_t)n + 1, 1);
+        va_start(args, fmt);
+        vsnprintf(t->data + t->len, (size_t)n + 1, fmt, args);
+        va_end(args);
+    }
+    t->len += (size_t)n;
+}
+
+static void text_fixed(Text *t, double value) {
+    t->data = grow(t->data, &t->capacity, t->len + FIXED7_MAX, 1);
+    t->len += format_fixed7(t->data + t->len, value);
+}
+
+// JSON has no infinity, a score that overflowed is null.
+static void text_json_number(Text *t, double value) {
+    if (isfinite(value)) {
+        text_printf(t, "%.17g", value);
+    }
+    else {
+        text_printf(t, "null");
+    }
+}
+
+static void format_text(Text *t, const GameStatus *st) {
+    text_printf(t, "game %zu\nputs %zu %zu\nclients %zu\nwaiting %zu\n",
+                st->game, st->puts, st->m, st->clients, st->waiting);
+    for (size_t i = 0; i < st->table.count; i++) {
+        const StatusPlayer *p = &st->table.players[i];
+        text_printf(t, "player %s %zu ", st->table.ids + p->id, p->puts);
+        text_fixed(t, p->penalty);
+        text_printf(t, " ");
+        text_fixed(t, p->score);
+        text_printf(t, "\n");
+    }
+}
+
+// Player ids are alphanumeric, they need no escaping.
+static void format_json(Text *t, const GameStatus *st) {
+    text_printf(t, "{\"game\":%zu,\"puts\":%zu,\"m\":%zu,\"clients\":%zu,\"waiting\":%zu,\"players\":[",
+                st->game, st->puts, st->m, st->clients, st->waiting);
+    for (size_t i = 0; i < st->table.count; i++) {
+        const StatusPlayer *p = &st->table.players[i];
+        text_printf(t, "%s{\"id\":\"%s\",\"puts\":%zu,\"penalty\":", i ? "," : "",
+                    st->table.ids + p->id, p->puts);
+        text_json_number(t, p->penalty);
+        text_printf(t, ",\"score\":");
+        text_json_number(t, p->score);
+        text_printf(t, "}");
+    }
+    text_printf(t, "]}\n");
+}
+
+static void set_response(StatusConn *c, const char *status, const char *type, const Text *body) {
+    char head[256];
+    int n = snprintf(head, sizeof head,
+                     "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                     status, type, body->len);
+    c->response = malloc((size_t)n + body->len);
+    if (!c->response) fatal("Out of memory");
+    memcpy(c->response, head, (size_t)n);
+    memcpy(c->response + n, body->data, body->len);
+    c->response_len = (size_t)n + body->len;
+    c->sent = 0;
+}
+
+// Answers a complete request head. Only the request line matters.
+static void respond(StatusServer *s, StatusConn *c) {
+    char *line_end = strpbrk(c->request, "\r\n");
+    *line_end = '\0';
+    char *saveptr = NULL;
+    char *method = strtok_r(c->request, " ", &saveptr);
+    char *path = strtok_r(NULL, " ", &saveptr);
+    if (path) {
+        path[strcspn(path, "?")] = '\0';
+    }
+
+    Text body = {0};
+    bool json = path && strcmp(path, "/status.json") == 0;
+    if (!method || strcmp(method, "GET") != 0) {
+        text_printf(&body, "Only GET is supported.\n");
+        set_response(c, "405 Method Not Allowed", "text/plain", &body);
+    }
+    else if (path && (json || strcmp(path, "/") == 0 || strcmp(path, "/status") == 0)) {
+        GameStatus *st = &s->status;
+        s->collect(st);
+        if (st->table.count > 1) {
+            qsort_r(st->table.players, st->table.count, sizeof *st->table.players, by_score,
+                    st->table.ids);
+        }
+        if (json) {
+            format_json(&body, st);
+        }
+        else {
+            format_text(&body, st);
+        }
+        set_response(c, "200 OK", json ? "application/json" : "text/plain; charset=utf-8", &body);
+    }
+    else if (path && strcmp(path, "/metrics") == 0) {
+        free(body.data);
+        FILE *out = open_memstream(&body.data, &body.len);
+        if (!out) {
+            syserr("open_memstream");
+        }
+        s->metrics(out);
+        fclose(out);
+        set_response(c, "200 OK", "text/plain; version=0.0.4", &body);
+    }
+    else {
+        text_printf(&body, "Try /status, /status.json or /metrics.\n");
+        set_response(c, "404 Not Found", "text/plain", &body);
+    }
+    free(body.data);
+}
+
+// Returns false once the connection is done with, answered or not.
+static bool serve_conn(StatusServer *s, StatusConn *c) {
+    if (!c->response) {
+        ssize_t r = recv(c->fd, c->request + c->request_len, ST_REQUEST_MAX - c->request_len, 0);
+        if (r < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        if (r == 0) {
+            return false;
+        }
+        c->request_len += (size_t)r;
+        c->request[c->request_len] = '\0';
+        // Closing with a header still unread would reset the connection, so the whole head is read.
+        if (!strstr(c->request, "\r\n\r\n") && !strstr(c->request, "\n\n")) {
+            return c->request_len < ST_REQUEST_MAX;
+        }
+        respond(s, c);
+    }
+    while (c->sent < c->response_len) {
+        ssize_t r = send(c->fd, c->response + c->sent, c->response_len - c->sent, MSG_NOSIGNAL);
+        if (r < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        c->sent += (size_t)r;
+    }
+    return false;
+}
+
+static void close_conn(StatusServer *s, size_t i) {
+    StatusConn *c = &s->conns[i];
+    close(c->fd);
+    free(c->request);
+    free(c->response);
+    *c = s->conns[--s->conn_count];
+}
+
+static void accept_conns(StatusServer *s, uint64_t now) {
+    while (s->conn_count < ST_CONNS) {
+        int fd = accept4(s->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+                error("status accept");
+            }
+            return;
+        }
+        StatusConn *c = &s->conns[s->conn_count++];
+        *c = (StatusConn) { .fd = fd, .request = malloc(ST_REQUEST_MAX + 1), .deadline = now + ST_TIMEOUT };
+        if (!c->request) fatal("Out of memory");
+    }
+}
+
+static void *serve(void *arg) {
+    StatusServer *s = arg;
+    struct pollfd fds[ST_CONNS + 2];
+
+    while (true) {
+        uint64_t now = now_ms();
+        int timeout = -1;
+        fds[0] = (struct pollfd) { .fd = s->stop_fd, .events = POLLIN };
+        // A full table leaves new readers in the backlog.
+        fds[1] = (struct pollfd) { .fd = s->conn_count < ST_CONNS ? s->listen_fd : -1, .events = POLLIN };
+        for (size_t i = 0; i < s->conn_count; i++) {
+            StatusConn *c = &s->conns[i];
+            fds[i + 2] = (struct pollfd) { .fd = c->fd, .events = c->response ? POLLOUT : POLLIN };
+            int left = c->deadline > now ? (int)(c->deadline - now) : 0;
+            if (timeout < 0 || left < timeout) {
+                timeout = left;
+            }
+        }
+
+        if (poll(fds, s->conn_count + 2, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            syserr("poll");
+        }
+        if (fds[0].revents) {
+            break;
+        }
+
+        now = now_ms();
+        // Backwards, so closing one moves an already handled connection into its place.
+        for (size_t i = s->conn_count; i-- > 0;) {
+            bool open = true;
+            if (fds[i + 2].revents) {
+                open = serve_conn(s, &s->conns[i]);
+            }
+            if (!open || s->conns[i].deadline <= now) {
+                close_conn(s, i);
+            }
+        }
+        if (fds[1].revents) {
+            accept_conns(s, now);
+        }
+    }
+
+    while (s->conn_count > 0) {
+        close_conn(s, s->conn_count - 1);
+    }
+    return NULL;
+}
+
+// A path is a Unix socket, anything else a TCP port on the loopback interface.
+static int open_listener(StatusServer *s, const char *where) {
+    if (strchr(where, '/')) {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        if (strlen(where) >= sizeof addr.sun_path) {
+            fatal("status socket path is too long: %s", where);
+        }
+        strcpy(addr.sun_path, where);
+
+        // A socket left behind by an earlier run is replaced, any other file is not.
+        struct stat st;
+        if (stat(where, &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(where);
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            syserr("cannot create a socket");
+        }
+        if (bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+            syserr("bind %s", where);
+        }
+        s->path = strdup(where);
+        if (!s->path) fatal("Out of memory");
+        return fd;
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = htons(read_port(where)),
+    };
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        syserr("cannot create a socket");
+    }
+    int yes = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes) < 0) {
+        syserr("setsockopt SO_REUSEADDR");
+    }
+    if (bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+        syserr("bind");
+    }
+    // Port 0 picks a random one, it would be of no use without telling which.
+    if (addr.sin_port == 0) {
+        if (getsockname(fd, (struct sockaddr *) &addr, &((socklen_t) {sizeof addr})) < 0) {
+            syserr("getsockname");
+        }
+        lgWrite(LG_INFO, "Status on port %hu\n", ntohs(addr.sin_port));
+    }
+    return fd;
+}
+
+void stStart(StatusServer *s, const char *where, void (*collect)(GameStatus *status),
+             void (*metrics)(FILE *out)) {
+    s->path = NULL;
+    s->listen_fd = open_listener(s, where);
+    if (listen(s->listen_fd, SOMAXCONN) < 0) {
+        syserr("listen");
+    }
+    s->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (s->stop_fd < 0) {
+        syserr("eventfd");
+    }
+    s->collect = collect;
+    s->metrics = metrics;
+    s->status = (GameStatus) {0};
+    s->conn_count = 0;
+
+    errno = pthread_create(&s->thread, NULL, serve, s);
+    if (errno != 0) {
+        syserr("pthread_create");
+    }
+}
+
+void stStop(StatusServer *s) {
+    uint64_t one = 1;
+    ssize_t r = write(s->stop_fd, &one, sizeof one);
+    (void)r;
+    pthread_join(s->thread, NULL);
+
+    close(s->listen_fd);
+    close(s->stop_fd);
+    if (s->path) {
+        unlink(s->path);
+        free(s->path);
+    }
+    stFree(&s->status.table);
+}
@@ -0,0 +1,101 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+// Connections the status thread serves at once, later ones wait in the backlog.
+#define ST_CONNS 64
+
+typedef struct {
+    // Offset of the NUL-terminated player id in the table's ids.
+    size_t id;
+    size_t puts;
+    double penalty;
+    double score;
+} StatusPlayer;
+
+// Players of one worker, or of the whole server once collected. Cleared tables keep their memory.
+typedef struct {
+    StatusPlayer *players;
+    size_t count;
+    size_t capacity;
+    char *ids;
+    size_t ids_len;
+    size_t ids_capacity;
+} StatusTable;
+
+// One player of a worker. The id is the client's own, its row is removed before the client goes.
+typedef struct {
+    const char *id;
+    uint64_t owner;
+    size_t puts;
+    double penalty;
+    double score;
+} StatusRow;
+
+// A worker's players, kept up to date as they play. The worker changes the rows and the status
+// thread copies them under lock, so either waits for one copy at most, never for the other's work.
+typedef struct {
+    pthread_mutex_t lock;
+    StatusRow *rows;
+    size_t count;
+    size_t capacity;
+} StatusBoard;
+
+typedef struct {
+    // Number of the game being played, the first one is 1.
+    size_t game;
+    size_t puts;
+    size_t m;
+    size_t clients;
+    // Players waiting for a COEFF line.
+    size_t waiting;
+    StatusTable table;
+} GameStatus;
+
+typedef struct {
+    int fd;
+    char *request;
+    size_t request_len;
+    char *response;
+    size_t response_len;
+    size_t sent;
+    uint64_t deadline;
+} StatusConn;
+
+// Read-only HTTP endpoint answered by its own thread, so a slow or stuck reader never delays a
+// worker. collect fills in the current status and metrics writes /metrics, they are only ever
+// called from that thread.
+typedef struct {
+    int listen_fd;
+    int stop_fd;
+    char *path;
+    pthread_t thread;
+    void (*collect)(GameStatus *status);
+    void (*metrics)(FILE *out);
+    GameStatus status;
+    StatusConn conns[ST_CONNS];
+    size_t conn_count;
+} StatusServer;
+
+void stClear(StatusTable *t);
+void stAdd(StatusTable *t, const char *id, size_t puts, double penalty, double score);
+void stAppend(StatusTable *dst, const StatusTable *src);
+void stFree(StatusTable *t);
+
+void stBoardInit(StatusBoard *b);
+size_t stBoardAdd(StatusBoard *b, const char *id, uint64_t owner);
+bool stBoardRemove(StatusBoard *b, size_t row, uint64_t *moved);
+void stBoardSet(StatusBoard *b, size_t row, size_t puts, double penalty, double score);
+void stBoardCopy(StatusTable *dst, StatusBoard *b);
+void stBoardFree(StatusBoard *b);
+
+void stStart(StatusServer *s, const char *where, void (*collect)(GameStatus *status),
+             void (*metrics)(FILE *out));
+void stStop(StatusServer *s);
+
+#endif
@@ -0,0 +1,99 @@
+#include "table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "err.h"
+
+#define CT_CHUNK 1024
+
+static ClientSlot *slot_at(const ClientTable *t, uint32_t slot) {
+    return &t->chunks[slot / CT_CHUNK][slot % CT_CHUNK];
+}
+
+static void grow(ClientTable *t) {
+    ClientSlot **chunks = realloc(t->chunks, (t->chunk_count + 1) * sizeof *chunks);
+    if (!chunks) fatal("Out of memory");
+    t->chunks = chunks;
+
+    ClientSlot *chunk = calloc(CT_CHUNK, sizeof *chunk);
+    if (!chunk) fatal("Out of memory");
+    t->chunks[t->chunk_count++] = chunk;
+
+    size_t capacity = t->capacity + CT_CHUNK;
+    uint32_t *free_slots = realloc(t->free_slots, capacity * sizeof *free_slots);
+    uint32_t *active = realloc(t->active, capacity * sizeof *active);
+    if (!free_slots || !active) fatal("Out of memory");
+    t->free_slots = free_slots;
+    t->active = active;
+
+    // Lower slots end up on top of the free stack.
+    for (size_t i = capacity; i > t->capacity; i--) {
+        t->free_slots[t->free_count++] = (uint32_t)(i - 1);
+        slot_at(t, (uint32_t)(i - 1))->generation = 1;
+    }
+    t->capacity = capacity;
+}
+
+void ctInit(ClientTable *t) {
+    memset(t, 0, sizeof *t);
+}
+
+void ctDestroy(ClientTable *t) {
+    for (size_t i = 0; i < t->chunk_count; i++) {
+        free(t->chunks[i]);
+    }
+    free(t->chunks);
+    free(t->free_slots);
+    free(t->active);
+    memset(t, 0, sizeof *t);
+}
+
+// Reserves a slot for a new client, the caller initializes the client itself.
+client_handle ctAdd(ClientTable *t) {
+    if (t->free_count == 0) {
+        grow(t);
+    }
+    uint32_t slot = t->free_slots[--t->free_count];
+    ClientSlot *s = slot_at(t, slot);
+    s->active_pos = (uint32_t)t->active_count;
+    t->active[t->active_count++] = slot;
+    return ((client_handle)s->generation << 32) | slot;
+}
+
+// Frees the slot, bumping its generation makes every handle to it stale.
+void ctRemove(ClientTable *t, client_handle h) {
+    uint32_t slot = (uint32_t)h;
+    ClientSlot *s = slot_at(t, slot);
+
+    uint32_t last = t->active[--t->active_count];
+    t->active[s->active_pos] = last;
+    slot_at(t, last)->active_pos = s->active_pos;
+
+    s->generation++;
+    if (s->generation == 0) {
+        s->generation = 1;
+    }
+    t->free_slots[t->free_count++] = slot;
+}
+
+// Returns NULL when the client the handle referred to is already gone.
+client_t *ctGet(const ClientTable *t, client_handle h) {
+    uint32_t slot = (uint32_t)h;
+    if (slot >= t->capacity) {
+        return NULL;
+    }
+    ClientSlot *s = slot_at(t, slot);
+    if (s->generation != (uint32_t)(h >> 32)) {
+        return NULL;
+    }
+    return &s->client;
+}
+
+size_t ctCount(const ClientTable *t) {
+    return t->active_count;
+}
+
+client_t *ctActive(const ClientTable *t, size_t i) {
+    return &slot_at(t, t->active[i])->client;
+}
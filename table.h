@@ -0,0 +1,42 @@
+#ifndef CLIENT_TABLE_H
+#define CLIENT_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "client.h"
+
+// Handle of a connected client: generation in the high half, slot index in the low half.
+// Generations start at 1, so a handle is never smaller than 2^32.
+typedef uint64_t client_handle;
+
+typedef struct {
+    client_t client;
+    uint32_t generation;
+    uint32_t active_pos;
+} ClientSlot;
+
+// Heap-backed table growing by whole chunks, so a client never moves once it got a slot.
+typedef struct {
+    ClientSlot **chunks;
+    size_t chunk_count;
+    size_t capacity;
+
+    uint32_t *free_slots;
+    size_t free_count;
+
+    // Slots of the connected clients, in no particular order.
+    uint32_t *active;
+    size_t active_count;
+} ClientTable;
+
+void ctInit(ClientTable *t);
+void ctDestroy(ClientTable *t);
+client_handle ctAdd(ClientTable *t);
+void ctRemove(ClientTable *t, client_handle h);
+client_t *ctGet(const ClientTable *t, client_handle h);
+size_t ctCount(const ClientTable *t);
+client_t *ctActive(const ClientTable *t, size_t i);
+
+#endif
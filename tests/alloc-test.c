@@ -0,0 +1,194 @@
+// Counts the allocations of the server's PUT handling once it is warmed up: parsing the PUT,
+// queueing PENALTY, BAD_PUT or the STATE answer and releasing them once sent. The text PUTs also
+// go through the old builders and strdup'ing queue for comparison. Exits with 1 when any PUT
+// allocated on the server's path.
+//
+// malloc, calloc and realloc are replaced for the whole program, also for the C library.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../client.h"
+#include "../messages.h"
+#include "../put.h"
+#include "../state.h"
+#include "../queue.h"
+#include "old-put.h"
+
+// The server's default K and N.
+#define K 100
+#define N 3
+#define WARMUP 10000
+#define PUTS 200000
+#define DELAY 25
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t allocations;
+
+void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+typedef enum { TEXT, BINARY, DELTA } Protocol;
+
+static uint64_t state;
+
+static uint64_t next_random(void) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static void no_complete(void) {
+}
+
+// The game never completes, every valid PUT is answered with STATE.
+static PutGame game = {.k = K, .m = SIZE_MAX, .on_complete = no_complete};
+
+// A PUT as a client sends it, every eighth one out of range.
+typedef struct {
+    char line[64];
+    size_t len;
+    uint32_t point;
+    double value;
+} Put;
+
+static void next_put(Put *p) {
+    p->point = (uint32_t)(next_random() % (K + 1));
+    p->value = (double)((int64_t)(next_random() % 100000001) - 50000000) / 1e7;
+    if (next_random() % 8 == 0) {
+        p->value *= 3;
+    }
+    p->len = (size_t)snprintf(p->line, sizeof p->line, "%" PRIu32 " %.7f", p->point, p->value);
+}
+
+static void parse_put(Put *p, char **point_str, char **value_str, double *point, double *value) {
+    if (!is_valid_put(p->line, p->len, point_str, value_str, point, value)) {
+        fprintf(stderr, "alloc-test: %s rejected\n", p->line);
+        exit(1);
+    }
+}
+
+// Every other PUT is followed by a complete write of everything queued, due or not. The PUT
+// after that finds the queue empty, the one after it finds its STATE still queued: it is early
+// and its STATE cannot reuse the queued buffer.
+static bool drain_after(int i) {
+    return i % 2 == 1;
+}
+
+// Returns the allocations of PUTS PUTs after WARMUP ones through process_put or process_put_frame.
+static uint64_t count(Protocol protocol) {
+    client_t c;
+    clientInit(&c, -1, N, K);
+    c.received_hello = true;
+    c.send_coeffs = true;
+    c.delay = DELAY;
+    if (protocol == BINARY) {
+        slUseBinary(&c.state);
+    }
+    else if (protocol == DELTA) {
+        slUseDelta(&c.state);
+    }
+
+    state = 88172645463325252ull;
+    uint64_t before = 0;
+    for (int i = 0; i < WARMUP + PUTS; i++) {
+        if (i == WARMUP) {
+            before = allocations;
+        }
+        Put p;
+        next_put(&p);
+        if (protocol == TEXT) {
+            char *point_str, *value_str;
+            double point, value;
+            parse_put(&p, &point_str, &value_str, &point, &value);
+            process_put(&game, &c, point_str, value_str, point, value);
+        }
+        else {
+            process_put_frame(&game, &c, p.point, p.value);
+        }
+        if (drain_after(i)) {
+            size_t ready = eqCollectDue(&c.q, UINT64_MAX);
+            for (size_t j = 0; j < ready; j++) {
+                eqPop(&c.q);
+            }
+        }
+    }
+    uint64_t counted = allocations - before;
+
+    clientDestroy(&c);
+    mbCacheFlush();
+    return counted;
+}
+
+// The same text PUTs through the old process_put.
+static uint64_t count_old(void) {
+    OldClient c = {.send_coeffs = true, .delay = DELAY};
+    old_eqInit(&c.q);
+    c.approx = calloc(K + 1, sizeof *c.approx);
+    if (!c.approx) {
+        fprintf(stderr, "alloc-test: out of memory\n");
+        exit(1);
+    }
+
+    state = 88172645463325252ull;
+    uint64_t before = 0;
+    for (int i = 0; i < WARMUP + PUTS; i++) {
+        if (i == WARMUP) {
+            before = allocations;
+        }
+        Put p;
+        next_put(&p);
+        char *point_str, *value_str;
+        double point, value;
+        parse_put(&p, &point_str, &value_str, &point, &value);
+        old_process_put(&c, point_str, value_str, point, value, K);
+        if (drain_after(i)) {
+            size_t ready = old_eqCollectDue(&c.q, UINT64_MAX);
+            for (size_t j = 0; j < ready; j++) {
+                old_eqPop(&c.q);
+            }
+        }
+    }
+    uint64_t counted = allocations - before;
+
+    old_eqDestroy(&c.q);
+    free(c.approx);
+    return counted;
+}
+
+int main(void) {
+    static const char *names[] = {"text", "binary", "delta"};
+    uint64_t total = 0;
+    for (Protocol p = TEXT; p <= DELTA; p++) {
+        uint64_t n = count(p);
+        printf("alloc-test %s: %d PUTs, %" PRIu64 " allocations, %.4f per PUT", names[p], PUTS, n,
+               (double)n / PUTS);
+        if (p == TEXT) {
+            uint64_t old = count_old();
+            printf(", old path %" PRIu64 " allocations, %.4f per PUT", old, (double)old / PUTS);
+        }
+        printf("\n");
+        total += n;
+    }
+    return total == 0 ? 0 : 1;
+}
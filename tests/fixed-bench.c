@@ -0,0 +1,79 @@
+// Throughput of format_fixed7 against snprintf("%.7f") on the values the server formats: PUT
+// values, STATE entries that are sums of a few PUTs, and scores that are sums of squares.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../fixed.h"
+
+#define VALUES 2000000
+#define ROUNDS 5
+
+static uint64_t state = 88172645463325252ull;
+
+static uint64_t next_random(void) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double put_value(void) {
+    return (double)((int64_t)(next_random() % 100000001) - 50000000) / 1e7;
+}
+
+// The best of ROUNDS, in millions of values per second.
+static double run(const double *values, size_t count, bool with_snprintf, size_t *sink) {
+    char buf[FIXED7_MAX];
+    double best = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        double start = seconds();
+        for (size_t i = 0; i < count; i++) {
+            *sink += with_snprintf ? (size_t)snprintf(buf, sizeof buf, "%.7f", values[i])
+                                   : format_fixed7(buf, values[i]);
+        }
+        double rate = count / (seconds() - start) / 1e6;
+        if (rate > best) {
+            best = rate;
+        }
+    }
+    return best;
+}
+
+int main(void) {
+    double *values = malloc(VALUES * sizeof *values);
+    if (!values) {
+        return 1;
+    }
+    const char *names[] = {"put", "state", "score"};
+    size_t sink = 0;
+
+    for (int kind = 0; kind < 3; kind++) {
+        for (size_t i = 0; i < VALUES; i++) {
+            double v = put_value();
+            if (kind == 1) {
+                v += put_value() + put_value();
+            }
+            else if (kind == 2) {
+                v = v * v * (double)(next_random() % 1000);
+            }
+            values[i] = v;
+        }
+        double old = run(values, VALUES, true, &sink);
+        double now = run(values, VALUES, false, &sink);
+        printf("fixed-bench %s: snprintf %.1f M/s, format_fixed7 %.1f M/s, %.1fx\n", names[kind], old, now,
+               now / old);
+    }
+    free(values);
+    // Keeps the formatting from being optimized away.
+    return sink == 0;
+}
@@ -0,0 +1,175 @@
+// Compares format_fixed7 byte for byte with snprintf("%.7f"). Exits with 1 on any mismatch.
+//
+// Every 7-decimal value in [-RANGE, RANGE] is checked, which covers every value a PUT can carry,
+// then the values where a hand-written rounding goes wrong first: exact ties, powers of two,
+// zeros, tiny negatives, the 64-bit limit where the fallback takes over, and random bit patterns.
+
+#include <math.h>
+#include <float.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../fixed.h"
+
+// PUT values lie in [-5, 5].
+#define RANGE 5
+#define STEPS ((int64_t)RANGE * 10000000)
+#define RANDOM_PATTERNS 2000000
+#define MAX_REPORTED 20
+
+// Each thread counts for itself and adds its count once done.
+static _Thread_local uint64_t checked;
+static atomic_uint_fast64_t total_checked;
+static atomic_uint_fast64_t mismatches;
+
+static void check(double value) {
+    char expected[FIXED7_MAX];
+    char got[FIXED7_MAX];
+    int expected_len = snprintf(expected, sizeof expected, "%.7f", value);
+    size_t len = format_fixed7(got, value);
+    checked++;
+    if (len != (size_t)expected_len || strcmp(got, expected) != 0) {
+        if (atomic_fetch_add(&mismatches, 1) < MAX_REPORTED) {
+            fprintf(stderr, "mismatch for %a (%.17g): \"%s\" expected \"%s\"\n", value, value, got,
+                    expected);
+        }
+    }
+}
+
+static void check_both_signs(double value) {
+    check(value);
+    check(-value);
+}
+
+typedef struct {
+    int64_t from;
+    int64_t to;
+    pthread_t thread;
+} Slice;
+
+// k / 10^7 is the double a PUT of that decimal parses to.
+static void *check_steps(void *arg) {
+    const Slice *s = arg;
+    for (int64_t k = s->from; k < s->to; k++) {
+        check((double)k / 1e7);
+    }
+    atomic_fetch_add(&total_checked, checked);
+    return NULL;
+}
+
+static void check_every_step(void) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) {
+        threads = 1;
+    }
+    Slice slices[threads];
+    int64_t total = 2 * STEPS + 1;
+    for (long i = 0; i < threads; i++) {
+        slices[i].from = -STEPS + total * i / threads;
+        slices[i].to = -STEPS + total * (i + 1) / threads;
+        if (pthread_create(&slices[i].thread, NULL, check_steps, &slices[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    for (long i = 0; i < threads; i++) {
+        pthread_join(slices[i].thread, NULL);
+    }
+}
+
+// value * 10^7 ends in exactly .5 for the odd multiples of 2^-8, those are the only exact ties.
+static void check_ties(void) {
+    for (int64_t m = 1; m <= 256 * 1000; m += 2) {
+        check_both_signs(ldexp((double)m, -8));
+    }
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    for (int i = 0; i < 1000000; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        // Odd m up to 2^48 keeps m / 2^8 below the 64-bit limit of the scaled value.
+        double tie = ldexp((double)((state >> 16) | 1), -8);
+        check_both_signs(tie);
+        check_both_signs(nextafter(tie, 0));
+        check_both_signs(nextafter(tie, INFINITY));
+    }
+}
+
+static void check_powers_of_two(void) {
+    for (int e = DBL_MIN_EXP - DBL_MANT_DIG; e < DBL_MAX_EXP; e++) {
+        double p = ldexp(1, e);
+        check_both_signs(p);
+        check_both_signs(nextafter(p, 0));
+        check_both_signs(nextafter(p, INFINITY));
+        check_both_signs(3 * p);
+    }
+}
+
+// printf keeps the sign of a value that rounds to zero, "-0.0000000".
+static void check_zeros_and_tiny(void) {
+    check(0.0);
+    check(-0.0);
+    check(-DBL_TRUE_MIN);
+    check(-DBL_MIN);
+    for (double v = 1e-8; v < 2e-7; v += 1e-10) {
+        check_both_signs(v);
+    }
+    const double halves[] = {0.5e-7, 1.5e-7, 2.5e-7, 4.99999995, 0.00000005};
+    for (size_t i = 0; i < sizeof halves / sizeof *halves; i++) {
+        check_both_signs(halves[i]);
+        check_both_signs(nextafter(halves[i], 0));
+        check_both_signs(nextafter(halves[i], INFINITY));
+    }
+}
+
+// Above 2^64 / 10^7, about 1.8e12, the scaled value no longer fits and snprintf takes over.
+static void check_fallback(void) {
+    double limit = ldexp(1, 64) / 1e7;
+    double below = limit, above = limit;
+    for (int i = 0; i < 100000; i++) {
+        check_both_signs(below);
+        check_both_signs(above);
+        below = nextafter(below, 0);
+        above = nextafter(above, INFINITY);
+    }
+    for (double v = 1e12; v < 1e300; v *= 1.37) {
+        check_both_signs(v);
+    }
+    check_both_signs(DBL_MAX);
+    check_both_signs(INFINITY);
+    check_both_signs(NAN);
+}
+
+static void check_random_patterns(void) {
+    uint64_t state = 88172645463325252ull;
+    for (int i = 0; i < RANDOM_PATTERNS; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        double v;
+        memcpy(&v, &state, sizeof v);
+        check(v);
+    }
+}
+
+int main(void) {
+    check_every_step();
+    check_ties();
+    check_powers_of_two();
+    check_zeros_and_tiny();
+    check_fallback();
+    check_random_patterns();
+
+    atomic_fetch_add(&total_checked, checked);
+    uint64_t bad = atomic_load(&mismatches);
+    printf("fixed-test: %" PRIu64 " values, %" PRIu64 " mismatches\n", (uint64_t)atomic_load(&total_checked),
+           bad);
+    return bad == 0 ? 0 : 1;
+}
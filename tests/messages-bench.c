@@ -0,0 +1,215 @@
+// Messages per second through the validators messages.c had before, which compile a POSIX regex
+// on every call, and through the hand-written ones, for each kind of line they check.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../messages.h"
+#include "old-messages.h"
+
+#define INPUTS 16
+// A measurement is repeated with twice the messages until it takes this long.
+#define MIN_SECONDS 0.25
+// The point limit of the PUTs and the number of values in a STATE line.
+#define K 10000
+#define SCORING_PLAYERS 10
+#define LINE_MAX (16 * (K + 1))
+
+typedef bool (*Validator)(const char *line, size_t len);
+
+static uint64_t state = 88172645463325252ull;
+
+static uint64_t next_random(void) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A value as the client prints it, in [-5, 5] with up to 7 decimals.
+static size_t append_value(char *out) {
+    double value = (double)((int64_t)(next_random() % 100000001) - 50000000) / 1e7;
+    return sprintf(out, "%.*f", (int)(next_random() % 8), value);
+}
+
+static size_t make_put(char *out) {
+    size_t len = sprintf(out, "%d ", (int)(next_random() % (K + 1)));
+    return len + append_value(out + len);
+}
+
+// A COEFF line for the default degree 4.
+static size_t make_coeff(char *out) {
+    size_t len = 0;
+    for (int i = 0; i < 5; i++) {
+        if (i > 0) out[len++] = ' ';
+        len += append_value(out + len);
+    }
+    return len;
+}
+
+static size_t make_state(char *out) {
+    size_t len = 0;
+    for (int i = 0; i <= K; i++) {
+        if (i > 0) out[len++] = ' ';
+        double value = (double)((int64_t)(next_random() % 1000000001) - 500000000) / 1e7;
+        len += sprintf(out + len, "%.7f", value);
+    }
+    return len;
+}
+
+static size_t make_scoring(char *out) {
+    size_t len = 0;
+    for (int i = 0; i < SCORING_PLAYERS; i++) {
+        len += sprintf(out + len, "%sB%d %.7f", i > 0 ? " " : "", (int)(next_random() % 100000),
+                       (double)(next_random() % 1000000000) / 1e3);
+    }
+    return len;
+}
+
+static bool old_put(const char *line, size_t len) {
+    char copy[64];
+    memcpy(copy, line, len + 1);
+    char *point_str, *value_str;
+    size_t point;
+    double value;
+    return old_is_valid_put(copy, len, &point_str, &value_str) &&
+           old_valid_point_value(point_str, value_str, &point, &value, K);
+}
+
+static bool new_put(const char *line, size_t len) {
+    char copy[64];
+    memcpy(copy, line, len + 1);
+    char *point_str, *value_str;
+    double parsed_point, value;
+    size_t point;
+    return is_valid_put(copy, len, &point_str, &value_str, &parsed_point, &value) &&
+           valid_point_value(point_str, parsed_point, value, &point, K);
+}
+
+// The client used to validate a COEFF line and then parse a copy of it.
+static bool old_coeff(const char *line, size_t len) {
+    char copy[256];
+    memcpy(copy, line, len + 1);
+    if (!old_is_valid_state_coeff(copy)) {
+        return false;
+    }
+    size_t count;
+    free(old_read_coeffs(copy, &count));
+    return true;
+}
+
+static bool new_coeff(const char *line, size_t len) {
+    (void)len;
+    size_t count;
+    double *coeffs = read_coeffs(line, &count);
+    free(coeffs);
+    return coeffs != NULL;
+}
+
+static bool old_state(const char *line, size_t len) {
+    (void)len;
+    return old_is_valid_state_coeff((char *)line);
+}
+
+static bool new_state(const char *line, size_t len) {
+    (void)len;
+    return is_valid_state_coeff(line);
+}
+
+static bool old_scoring(const char *line, size_t len) {
+    (void)len;
+    return old_is_valid_scoring((char *)line);
+}
+
+static bool new_scoring(const char *line, size_t len) {
+    (void)len;
+    return is_valid_scoring(line);
+}
+
+static bool old_bad_put(const char *line, size_t len) {
+    (void)len;
+    return old_is_valid_bad_put((char *)line);
+}
+
+static bool new_bad_put(const char *line, size_t len) {
+    (void)len;
+    return is_valid_bad_put(line);
+}
+
+// Returns the time taken, or a negative number when a valid message was rejected.
+static double run(Validator validate, char **lines, const size_t *lens, size_t count) {
+    double start = seconds();
+    for (size_t i = 0; i < count; i++) {
+        if (!validate(lines[i % INPUTS], lens[i % INPUTS])) {
+            return -1;
+        }
+    }
+    return seconds() - start;
+}
+
+static double rate(Validator validate, char **lines, const size_t *lens) {
+    size_t count = 1;
+    double elapsed;
+    while ((elapsed = run(validate, lines, lens, count)) < MIN_SECONDS) {
+        if (elapsed < 0) {
+            return -1;
+        }
+        count *= 2;
+    }
+    return count / elapsed;
+}
+
+int main(void) {
+    static const struct {
+        const char *name;
+        size_t (*make)(char *out);
+        Validator old_validate;
+        Validator new_validate;
+    } kinds[] = {
+        {"PUT", make_put, old_put, new_put},
+        {"BAD_PUT", make_put, old_bad_put, new_bad_put},
+        {"COEFF", make_coeff, old_coeff, new_coeff},
+        {"SCORING", make_scoring, old_scoring, new_scoring},
+        {"STATE K=10000", make_state, old_state, new_state},
+    };
+
+    char *lines[INPUTS];
+    size_t lens[INPUTS];
+    for (size_t i = 0; i < INPUTS; i++) {
+        lines[i] = malloc(LINE_MAX);
+        if (!lines[i]) {
+            return 1;
+        }
+    }
+
+    int status = 0;
+    for (size_t k = 0; k < sizeof kinds / sizeof *kinds; k++) {
+        for (size_t i = 0; i < INPUTS; i++) {
+            lens[i] = kinds[k].make(lines[i]);
+        }
+        double old = rate(kinds[k].old_validate, lines, lens);
+        double now = rate(kinds[k].new_validate, lines, lens);
+        if (old < 0 || now < 0) {
+            fprintf(stderr, "messages-bench %s: a valid message was rejected\n", kinds[k].name);
+            status = 1;
+            continue;
+        }
+        printf("messages-bench %s: regex %.0f/s, hand-written %.0f/s, %.0fx\n", kinds[k].name, old, now,
+               now / old);
+    }
+
+    for (size_t i = 0; i < INPUTS; i++) {
+        free(lines[i]);
+    }
+    return status;
+}
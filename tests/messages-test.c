@@ -0,0 +1,320 @@
+// Runs the validators messages.c had before, which use POSIX regexes, and the hand-written ones over
+// the same inputs. Exits with 1 on any difference in what they accept or in the values they parse.
+//
+// The inputs are edge cases written out below and lines generated around the protocol grammar:
+// numbers with leading zeros, signs, exponents, more than 15 digits and too many decimals, missing,
+// doubled and other separators, and single characters deleted, inserted or replaced.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../messages.h"
+#include "old-messages.h"
+
+#define GENERATED 200000
+#define MAX_REPORTED 20
+#define LINE_MAX 1024
+
+static uint64_t checked;
+static uint64_t mismatches;
+static uint64_t valid_state;
+static uint64_t valid_put;
+
+static uint64_t state = 88172645463325252ull;
+
+static uint64_t next_random(void) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static void report(const char *what, const char *s, size_t len) {
+    if (mismatches++ >= MAX_REPORTED) {
+        return;
+    }
+    fprintf(stderr, "%s differs for \"", what);
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = s[i];
+        if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\') {
+            fputc(c, stderr);
+        }
+        else {
+            fprintf(stderr, "\\x%02x", c);
+        }
+    }
+    fprintf(stderr, "\"\n");
+}
+
+// The text validators see s up to its first '\0'.
+static void check_line(const char *s) {
+    char copy[LINE_MAX];
+    size_t len = strlen(s);
+    memcpy(copy, s, len + 1);
+    checked++;
+
+    bool old_state = old_is_valid_state_coeff(copy);
+    if (old_state != is_valid_state_coeff(s)) {
+        report("is_valid_state_coeff", s, len);
+    }
+    valid_state += old_state;
+
+    size_t count;
+    double *values = read_coeffs(s, &count);
+    if (!values != !old_state) {
+        report("read_coeffs", s, len);
+    }
+    else if (values) {
+        size_t old_count;
+        double *old_values = old_read_coeffs(copy, &old_count);
+        if (count != old_count || memcmp(values, old_values, count * sizeof *values) != 0) {
+            report("read_coeffs values", s, len);
+        }
+        free(old_values);
+    }
+    free(values);
+
+    memcpy(copy, s, len + 1);
+    if (old_is_valid_bad_put(copy) != is_valid_bad_put(s)) {
+        report("is_valid_bad_put", s, len);
+    }
+    if (old_is_valid_scoring(copy) != is_valid_scoring(s)) {
+        report("is_valid_scoring", s, len);
+    }
+}
+
+// A PUT payload of len bytes, which may hold '\0'. The point is checked against a few K.
+static void check_put(const char *s, size_t len) {
+    static const size_t limits[] = {0, 3, 100, 10000, 4294967295u};
+    char old_line[LINE_MAX];
+    char new_line[LINE_MAX];
+    memcpy(old_line, s, len);
+    memcpy(new_line, s, len);
+    old_line[len] = new_line[len] = '\0';
+    checked++;
+
+    char *old_point, *old_value, *point_str, *value_str;
+    double point, value;
+    bool old_valid = old_is_valid_put(old_line, len, &old_point, &old_value);
+    if (old_valid != is_valid_put(new_line, len, &point_str, &value_str, &point, &value)) {
+        report("is_valid_put", s, len);
+        return;
+    }
+    if (!old_valid) {
+        return;
+    }
+    valid_put++;
+    if (strcmp(old_point, point_str) != 0 || strcmp(old_value, value_str) != 0) {
+        report("is_valid_put split", s, len);
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof limits / sizeof *limits; i++) {
+        size_t old_out, out;
+        double old_out_value;
+        bool old_in_range = old_valid_point_value(old_point, old_value, &old_out, &old_out_value, limits[i]);
+        if (old_in_range != valid_point_value(point_str, point, value, &out, limits[i])) {
+            report("valid_point_value", s, len);
+        }
+        else if (old_in_range && (old_out != out || memcmp(&old_out_value, &value, sizeof value) != 0)) {
+            report("valid_point_value values", s, len);
+        }
+    }
+}
+
+static void check_both(const char *s) {
+    check_line(s);
+    check_put(s, strlen(s));
+}
+
+static void check_edge_cases(void) {
+    static const char *lines[] = {
+        "", " ", "-", "--1", "+1", "-0", "0", "00", "000.000", "007", "-007.5", "0.", "-0.", "1.",
+        ".5", "-.5", "1..2", "1.2.3", "1.1234567", "1.12345678", "-5.0000000", "5.00000001",
+        "1e5", "1E5", "1e-5", "1.5e3", "0x10", "inf", "nan", "-inf", "1,5",
+        "123456789012345", "1234567890123456", "12345678901234567890", "99999999999999999999.9999999",
+        "0.0000001", "-0.0000001", "000000000000000000001.1000000", "9007199254740993",
+        "1 2", "1  2", " 1 2", "1 2 ", "1\t2", "1 -", "- 1", "1 2 3", "1 -2.5 3.1234567 -0",
+        "1 2.12345678", "1\r", "1 2\r", "1\n2",
+        "a 1", "a1 -2.5", "a 1 b 2", "a 1 b", "a 1  b 2", "a  1", " a 1", "a 1 ", "_ 1", "a-b 1",
+        "A9 5 z 0.0000001", "a 1.12345678", "1 1", "a 1 1 1",
+        "3 0.5", "3.0 0.5", "3.0000000 5", "3.00000001 5", "3.1 1", "-3 1", "-0 1", "+3 1",
+        "10000 -5", "10001 5", "4294967295 1", "4294967296 1", "0 5.0000001", "0 -5.0000001",
+        "0 -0", "0 -0.0000000",
+    };
+    for (size_t i = 0; i < sizeof lines / sizeof *lines; i++) {
+        check_both(lines[i]);
+    }
+
+    // Numbers strtod only gets as infinity.
+    char huge[LINE_MAX];
+    memset(huge, '9', 400);
+    huge[400] = '\0';
+    check_both(huge);
+    memcpy(huge, "0 ", 2);
+    check_both(huge);
+    memcpy(huge + 397, " 1", 3);
+    check_both(huge);
+
+    // Bytes after a '\0' are part of a PUT payload, but not of a line the text validators see.
+    static const struct {
+        const char *s;
+        size_t len;
+    } embedded[] = {
+        {"1\0 2", 4}, {"1 2\0", 4}, {"1 \0002", 4}, {"1 2\0003", 5}, {"\0 1", 3}, {"1\0002 3", 5},
+        {"1 2.\0", 5}, {"-\0 1", 4},
+    };
+    for (size_t i = 0; i < sizeof embedded / sizeof *embedded; i++) {
+        check_put(embedded[i].s, embedded[i].len);
+        check_line(embedded[i].s);
+    }
+}
+
+static size_t append(char *out, size_t len, const char *s) {
+    size_t n = strlen(s);
+    if (len + n < LINE_MAX / 2) {
+        memcpy(out + len, s, n);
+        len += n;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+static size_t append_digits(char *out, size_t len, size_t count) {
+    for (size_t i = 0; i < count && len < LINE_MAX / 2; i++) {
+        out[len++] = '0' + next_random() % 10;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Mostly numbers of the grammar, sometimes a step outside it.
+static size_t append_number(char *out, size_t len) {
+    if (next_random() % 4 == 0) len = append(out, len, "-");
+    if (next_random() % 50 == 0) len = append(out, len, next_random() % 2 ? "+" : "-");
+    if (next_random() % 5 == 0) len = append(out, len, next_random() % 2 ? "0" : "000");
+
+    size_t digits = next_random() % 8 == 0 ? next_random() % 21 : 1 + next_random() % 3;
+    if (digits == 0 && next_random() % 4 != 0) digits = 1;
+    len = append_digits(out, len, digits);
+
+    if (next_random() % 2) {
+        len = append(out, len, ".");
+        size_t fraction = next_random() % 10 == 0 ? 8 + next_random() % 2 : next_random() % 8;
+        len = append_digits(out, len, fraction);
+    }
+    if (next_random() % 40 == 0) {
+        len = append(out, len, next_random() % 2 ? "e" : "E");
+        if (next_random() % 2) len = append(out, len, next_random() % 2 ? "-" : "+");
+        len = append_digits(out, len, 1 + next_random() % 3);
+    }
+    return len;
+}
+
+static size_t append_separator(char *out, size_t len) {
+    switch (next_random() % 40) {
+        case 0: return len;
+        case 1: return append(out, len, "  ");
+        case 2: return append(out, len, "\t");
+        default: return append(out, len, " ");
+    }
+}
+
+static size_t generate_numbers(char *out, size_t max_count) {
+    size_t len = 0;
+    out[0] = '\0';
+    if (next_random() % 40 == 0) len = append(out, len, " ");
+    size_t count = 1 + next_random() % max_count;
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) len = append_separator(out, len);
+        len = append_number(out, len);
+    }
+    if (next_random() % 40 == 0) len = append(out, len, " ");
+    return len;
+}
+
+static size_t generate_scoring(char *out) {
+    static const char id_chars[] = "abcXYZ0189";
+    size_t len = 0;
+    out[0] = '\0';
+    size_t pairs = 1 + next_random() % 5;
+    for (size_t i = 0; i < pairs; i++) {
+        if (i > 0) len = append_separator(out, len);
+        size_t id_len = next_random() % 30 == 0 ? 0 : 1 + next_random() % 8;
+        for (size_t j = 0; j < id_len; j++) {
+            char c[2] = {id_chars[next_random() % (sizeof id_chars - 1)], '\0'};
+            len = append(out, len, c);
+        }
+        if (next_random() % 30 == 0) len = append(out, len, next_random() % 2 ? "_" : "-");
+        len = append_separator(out, len);
+        len = append_number(out, len);
+    }
+    return len;
+}
+
+static const char noise[] = "0123456789-+.eE aZ_\t\r\n";
+
+static size_t generate_noise(char *out) {
+    size_t len = next_random() % 13;
+    for (size_t i = 0; i < len; i++) {
+        out[i] = noise[next_random() % (sizeof noise - 1)];
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Deletes, inserts or replaces one character.
+static size_t mutate(char *out, size_t len) {
+    size_t at = len == 0 ? 0 : next_random() % len;
+    char c = noise[next_random() % (sizeof noise - 1)];
+    switch (next_random() % 3) {
+        case 0:
+            if (len == 0) break;
+            memmove(out + at, out + at + 1, len - at);
+            return len - 1;
+        case 1:
+            memmove(out + at + 1, out + at, len - at + 1);
+            out[at] = c;
+            return len + 1;
+        default:
+            if (len == 0) break;
+            out[at] = c;
+    }
+    return len;
+}
+
+static void check_generated(void) {
+    char line[LINE_MAX];
+    for (int i = 0; i < GENERATED; i++) {
+        size_t len;
+        switch (i % 6) {
+            case 0: len = generate_numbers(line, 2); break;
+            case 1: len = generate_numbers(line, next_random() % 8 == 0 ? 40 : 6); break;
+            case 2: len = generate_scoring(line); break;
+            case 3: len = generate_noise(line); break;
+            case 4: len = mutate(line, generate_numbers(line, 3)); break;
+            default: len = mutate(line, generate_scoring(line)); break;
+        }
+        check_line(line);
+        check_put(line, len);
+
+        // The same PUT payload with a '\0' somewhere in it.
+        if (len > 0 && i % 16 == 0) {
+            line[next_random() % len] = '\0';
+            check_put(line, len);
+        }
+    }
+}
+
+int main(void) {
+    check_edge_cases();
+    check_generated();
+
+    printf("messages-test: %" PRIu64 " inputs, %" PRIu64 " valid STATE lines, %" PRIu64
+           " valid PUTs, %" PRIu64 " mismatches\n", checked, valid_state, valid_put, mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
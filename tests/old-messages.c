@@ -0,0 +1,150 @@
+// The validators messages.c had before the hand-written scanner, unchanged apart from the names.
+// They compile a POSIX regex on every call.
+
+#include "old-messages.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <regex.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../err.h"
+
+static bool is_matching(const char *pattern, const char *line) {
+    regex_t regex;
+    int ret;
+
+    ret = regcomp(&regex, pattern, REG_EXTENDED);
+    if (ret != 0) {
+
+        return false;
+    }
+
+    ret = regexec(&regex, line, 0, NULL, 0);
+    regfree(&regex);
+
+    return (ret == 0);
+}
+
+static bool is_rational(const char *s, size_t len) {
+    if (*s == '-') {
+        s++;
+        len--;
+    }
+
+    if (len == 0) return false;
+    if (!isdigit((unsigned char)*s)) return false;
+    while (isdigit((unsigned char)*s) && len > 0) {
+        s++;
+        len--;
+    }
+
+    if (len == 0) return true;
+    if (*s != '.') return false;
+    s++;
+    len--;
+    if (len > 7) return false;
+
+    for (size_t i = 0; i < len; i++) {
+        if (!isdigit((unsigned char)*s))
+            return false;
+        s++;
+    }
+    return true;
+}
+
+bool old_is_valid_state_coeff(char *line) {
+    const char *pattern = "^-?[0-9]+(\\.[0-9]{0,7})?( -?[0-9]+(\\.[0-9]{0,7})?)*$";
+    return is_matching(pattern, line);
+}
+
+bool old_is_valid_bad_put(char *line) {
+    const char *pattern = "^-?[0-9]+(\\.[0-9]{0,7})? -?[0-9]+(\\.[0-9]{0,7})?$";
+    return is_matching(pattern, line);
+}
+
+bool old_is_valid_scoring(char *line) {
+    const char *pattern = "^[A-Za-z0-9]+ -?[0-9]+(\\.[0-9]{0,7})?( [A-Za-z0-9]+ -?[0-9]+(\\.[0-9]{0,7})?)*$";
+    return is_matching(pattern, line);
+}
+
+bool old_is_valid_put(const char *line, size_t linelen, char** point, char** value) {
+    char *sp = memchr(line, ' ', linelen);
+    if (!sp) {
+        return false;
+    }
+
+    size_t point_len = sp - line;
+    size_t value_len = linelen - point_len - 1;
+
+    if (!is_rational(line, point_len) || !is_rational(sp+1, value_len)) {
+        return false;
+    }
+
+    *sp = '\0';
+
+    *point = (char *)line;
+    *value = (char *)(sp + 1);
+
+    return true;
+}
+
+static bool is_valid_point(char *line) {
+    const char *pattern = "^[0-9]+(\\.[0]{0,7})?$";
+    return is_matching(pattern, line);
+}
+
+bool old_valid_point_value(char *point_str, char *value_str,
+        size_t *out_point, double *out_value, size_t K) {
+
+    if (!is_valid_point(point_str))
+        return false;
+
+    char *endptr;
+    errno = 0;
+
+    double point = strtod(point_str, &endptr);
+    if (errno != 0 || *endptr != '\0' || point > (double) K || point < 0) {
+        return false;
+    }
+
+    errno = 0;
+    double value = strtod(value_str, &endptr);
+    if (errno != 0 || *endptr != '\0' || value < -5.0 || value > 5.0) {
+        return false;
+    }
+
+    *out_point = (size_t) point;
+    *out_value = value;
+    return true;
+}
+
+double *old_read_coeffs(char* payload, size_t *count) {
+
+    size_t coeff_count = 0;
+    char *copy = strdup(payload);
+    if (!copy) {
+        syserr("strdup");
+    }
+
+    char *saveptr, *tok;
+    for (tok = strtok_r(copy, " ", &saveptr);tok != NULL; tok = strtok_r(NULL, " ", &saveptr)) {
+        coeff_count++;
+    }
+
+    free(copy);
+
+    double *coeffs = malloc(coeff_count * sizeof *coeffs);
+    if (!coeffs)
+        fatal("Out of memory");
+
+    size_t id = 0;
+    for (tok = strtok_r(payload, " ", &saveptr);tok != NULL; tok = strtok_r(NULL, " ", &saveptr)) {
+        coeffs[id++] = strtod(tok, NULL);
+    }
+
+    *count = coeff_count;
+
+    return coeffs;
+}
@@ -0,0 +1,17 @@
+#ifndef MIM_OLD_MESSAGES_H
+#define MIM_OLD_MESSAGES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The validators messages.c had before the hand-written scanner, kept only for the tests.
+
+bool old_is_valid_state_coeff(char *line);
+bool old_is_valid_bad_put(char *line);
+bool old_is_valid_scoring(char *line);
+bool old_is_valid_put(const char *line, size_t linelen, char **point, char **value);
+bool old_valid_point_value(char *point_str, char *value_str, size_t *out_point, double *out_value,
+                           size_t K);
+double *old_read_coeffs(char *payload, size_t *count);
+
+#endif
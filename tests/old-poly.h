@@ -0,0 +1,17 @@
+#ifndef MIM_OLD_POLY_H
+#define MIM_OLD_POLY_H
+
+#include <stddef.h>
+
+// calculate_f as messages.c had it before pfFill, a power loop for one x. Kept only for the tests.
+static inline double old_calculate_f(size_t n, const double *coeffs, size_t x) {
+    double fx = 0.0;
+    double xi = 1.0;
+    for (size_t i = 0; i <= n; i++) {
+        fx  += coeffs[i] * xi;
+        xi  *= (double)x;
+    }
+    return fx;
+}
+
+#endif
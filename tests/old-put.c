@@ -0,0 +1,230 @@
+// The event queue and message builders the server had before the shared message buffers,
+// unchanged apart from the names. process_put is the old one with today's validator, so only the
+// way the answers are built and queued differs.
+
+#include "old-put.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common.h"
+#include "../err.h"
+#include "../messages.h"
+
+#define READY_INITIAL 8
+
+static void swap_events(OldScheduledEvent *a, OldScheduledEvent *b) {
+    OldScheduledEvent tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static bool earlier(const OldScheduledEvent *a, const OldScheduledEvent *b) {
+    return a->send_time < b->send_time || (a->send_time == b->send_time && a->id < b->id);
+}
+
+static OldScheduledEvent *ready_at(const OldEventQueue *q, size_t i) {
+    return &q->ready[(q->ready_head + i) & (q->ready_capacity - 1)];
+}
+
+// Removes the heap top without releasing its message.
+static void heap_remove_top(OldEventQueue *q) {
+    q->heap[0] = q->heap[--q->size];
+
+    size_t idx = 0;
+    while (true) {
+        size_t left = 2 * idx + 1;
+        size_t right = left + 1;
+        size_t smallest = idx;
+
+        if (left < q->size && earlier(&q->heap[left], &q->heap[smallest])) {
+            smallest = left;
+        }
+        if (right < q->size && earlier(&q->heap[right], &q->heap[smallest])) {
+            smallest = right;
+        }
+
+        if (smallest == idx)
+            break;
+
+        swap_events(&q->heap[idx], &q->heap[smallest]);
+        idx = smallest;
+    }
+}
+
+static void ready_push(OldEventQueue *q, OldScheduledEvent evt) {
+    if (q->ready_count == q->ready_capacity) {
+        size_t new_cap = q->ready_capacity ? q->ready_capacity * 2 : READY_INITIAL;
+        OldScheduledEvent *tmp = malloc(new_cap * sizeof *tmp);
+        if (!tmp) fatal("Out of memory");
+        for (size_t i = 0; i < q->ready_count; ++i) {
+            tmp[i] = *ready_at(q, i);
+        }
+        free(q->ready);
+        q->ready = tmp;
+        q->ready_head = 0;
+        q->ready_capacity = new_cap;
+    }
+    q->ready[(q->ready_head + q->ready_count++) & (q->ready_capacity - 1)] = evt;
+}
+
+void old_eqInit(OldEventQueue *q) {
+    q->heap = malloc(sizeof(OldScheduledEvent) * 8);
+    if (!q->heap) fatal("Out of memory");
+    q->size = 0;
+    q->capacity = 8;
+    q->last_put_id = SIZE_MAX;
+    q->next_id = 0;
+    q->ready = NULL;
+    q->ready_head = q->ready_count = q->ready_capacity = 0;
+}
+
+void old_eqDestroy(OldEventQueue *q) {
+    for (size_t i = 0; i < q->size; ++i) {
+        free(q->heap[i].msg);
+    }
+    for (size_t i = 0; i < q->ready_count; ++i) {
+        free(ready_at(q, i)->msg);
+    }
+    free(q->heap);
+    free(q->ready);
+    q->heap = NULL;
+    q->ready = NULL;
+    q->size = q->capacity = 0;
+    q->ready_head = q->ready_count = q->ready_capacity = 0;
+    q->last_put_id = SIZE_MAX;
+}
+
+void old_eqPush(OldEventQueue *q, uint64_t when, const char *msg, bool is_put_response) {
+    if (q->size + 1 > q->capacity) {
+        size_t new_cap = q->capacity * 2;
+        OldScheduledEvent *tmp = realloc(q->heap, new_cap * sizeof *tmp);
+        if (!tmp) fatal("Out of memory");
+        q->heap = tmp;
+        q->capacity = new_cap;
+    }
+
+    OldScheduledEvent *evt = &q->heap[q->size];
+    evt->send_time = when;
+    evt->id = q->next_id++;
+    evt->msg = strdup(msg);
+    if (!evt->msg) fatal("Out of memory");
+    evt->ptr = evt->msg;
+    evt->remaining = strlen(evt->msg);
+
+    if (is_put_response) {
+        q->last_put_id = evt->id;
+    }
+
+    size_t idx = q->size++;
+    while (idx > 0) {
+        size_t parent = (idx - 1) / 2;
+        if (!earlier(&q->heap[idx], &q->heap[parent]))
+            break;
+
+        swap_events(&q->heap[parent], &q->heap[idx]);
+        idx = parent;
+    }
+}
+
+// Releases the event that is sent next: the oldest ready one, otherwise the heap top.
+void old_eqPop(OldEventQueue *q) {
+    OldScheduledEvent *evt;
+    if (q->ready_count > 0) evt = ready_at(q, 0);
+    else if (q->size > 0) evt = &q->heap[0];
+    else return;
+
+    if (evt->id == q->last_put_id) {
+        q->last_put_id = SIZE_MAX;
+    }
+    free(evt->msg);
+
+    if (q->ready_count > 0) {
+        q->ready_head = (q->ready_head + 1) & (q->ready_capacity - 1);
+        q->ready_count--;
+    }
+    else {
+        heap_remove_top(q);
+    }
+}
+
+bool old_eqLastPutSend(OldEventQueue *q) {
+    return (q->last_put_id == SIZE_MAX);
+}
+
+size_t old_eqCollectDue(OldEventQueue *q, uint64_t now) {
+    while (q->size > 0 && q->heap[0].send_time <= now) {
+        ready_push(q, q->heap[0]);
+        heap_remove_top(q);
+    }
+    return q->ready_count;
+}
+
+static char *create_penalty_msg(const char *point_str, const char *value_str) {
+    size_t len = 8 + strlen(point_str) + 1 + strlen(value_str) + 2 + 1;
+    char *buf = malloc(len);
+    if (!buf) fatal("Out of memory");
+    snprintf(buf, len, "PENALTY %s %s\r\n", point_str, value_str);
+    return buf;
+}
+
+static char *create_badput_msg(const char *point_str, const char *value_str) {
+    size_t len = 8 + strlen(point_str) + 1 + strlen(value_str) + 2 + 1;
+    char *buf = malloc(len);
+    if (!buf) fatal("Out of memory");
+    snprintf(buf, len, "BAD_PUT %s %s\r\n", point_str, value_str);
+    return buf;
+}
+
+static char *create_state_msg(double *approx, size_t K) {
+    size_t estimate = 6 + (K + 1) * 32 + K + 2 + 1;
+    char *buf = malloc(estimate);
+    if (!buf) fatal("Out of memory");
+    char *p = buf;
+    size_t remaining = estimate;
+
+    int n = snprintf(p, remaining, "STATE");
+    p += n;
+    remaining -= n;
+
+    for (size_t i = 0; i <= K; ++i) {
+        *p++ = ' ';
+        remaining--;
+        n = snprintf(p, remaining, "%.7f", approx[i]);
+        p += n;
+        remaining -= n;
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+    *p = '\0';
+
+    return buf;
+}
+
+void old_process_put(OldClient *c, char *point_str, char *value_str, double parsed_point,
+                     double value, size_t K) {
+    size_t point;
+    uint64_t now = now_ms();
+
+    if (!old_eqLastPutSend(&c->q) || !c->send_coeffs) {
+        char * msg = create_penalty_msg(point_str, value_str);
+        old_eqPush(&c->q, now, msg, false);
+        free(msg);
+        c->penalty += 20;
+    }
+    if (!valid_point_value(point_str, parsed_point, value, &point, K)) {
+        char * msg = create_badput_msg(point_str, value_str);
+        old_eqPush(&c->q, now + 1000, msg, true);
+        free(msg);
+        c->penalty += 10;
+    }
+    else {
+        c->approx[point] += value;
+        c->put_send++;
+
+        char * msg = create_state_msg(c->approx, K);
+        old_eqPush(&c->q, now + c->delay, msg, true);
+        free(msg);
+    }
+}
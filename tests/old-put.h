@@ -0,0 +1,52 @@
+#ifndef MIM_OLD_PUT_H
+#define MIM_OLD_PUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The PUT handling the server had before the shared message buffers, kept only for the tests: the
+// answers are built with malloc'd builders and copied again by a queue that strdup's every message.
+
+typedef struct {
+    uint64_t send_time;
+    char *msg;
+    char *ptr;
+    size_t remaining;
+    size_t id;
+} OldScheduledEvent;
+
+typedef struct {
+    OldScheduledEvent *heap;
+    size_t size;
+    size_t capacity;
+    size_t last_put_id;
+    size_t next_id;
+
+    OldScheduledEvent *ready;
+    size_t ready_head;
+    size_t ready_count;
+    size_t ready_capacity;
+} OldEventQueue;
+
+// What the old process_put touched of client_t.
+typedef struct {
+    OldEventQueue q;
+    bool send_coeffs;
+    double *approx;
+    double penalty;
+    size_t put_send;
+    uint64_t delay;
+} OldClient;
+
+void old_eqInit(OldEventQueue *q);
+void old_eqDestroy(OldEventQueue *q);
+void old_eqPush(OldEventQueue *q, uint64_t when, const char *msg, bool is_put_response);
+void old_eqPop(OldEventQueue *q);
+bool old_eqLastPutSend(OldEventQueue *q);
+size_t old_eqCollectDue(OldEventQueue *q, uint64_t now);
+
+void old_process_put(OldClient *c, char *point_str, char *value_str, double parsed_point,
+                     double value, size_t K);
+
+#endif
@@ -0,0 +1,70 @@
+// Time to fill a whole f(0..K) table with the power loop the server used before, one x at a time,
+// and with each pfFill variant the CPU supports.
+//
+// poly.c is included, so every variant is called directly.
+
+#include "../poly.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "old-poly.h"
+
+#define K 10000
+#define ROUNDS 2000
+
+typedef void (*Fill)(const double *coeffs, size_t degree, double *out, size_t from, size_t to);
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_power_loop(const double *coeffs, size_t degree, double *out, size_t from, size_t to) {
+    for (size_t x = from; x < to; x++) {
+        out[x - from] = old_calculate_f(degree, coeffs, x);
+    }
+}
+
+// Nanoseconds per point, the best of ROUNDS fills.
+static double measure(Fill fill, const double *coeffs, size_t degree, double *out, double *sink) {
+    double best = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        double start = seconds();
+        fill(coeffs, degree, out, 0, K + 1);
+        double elapsed = seconds() - start;
+        *sink += out[r % (K + 1)];
+        if (r == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best / (K + 1) * 1e9;
+}
+
+int main(void) {
+    static const double coeffs[MAX_N + 1] = {1.1, -2.2, 3.3, -4.4, 0.5, 0.6, -0.7, 0.8, 0.9};
+    double *out = malloc((K + 1) * sizeof *out);
+    if (!out) {
+        return 1;
+    }
+    double sink = 0;
+
+    for (size_t degree = 2; degree <= MAX_N; degree += 2) {
+        double old = measure(fill_power_loop, coeffs, degree, out, &sink);
+        double generic = measure(fill_generic, coeffs, degree, out, &sink);
+        printf("poly-bench N=%zu K=%d: power loop %.2f ns/point, generic %.2f ns/point (%.1fx)", degree, K,
+               old, generic, old / generic);
+#if defined(__x86_64__) || defined(__i386__)
+        if (__builtin_cpu_supports("avx2")) {
+            double avx2 = measure(fill_avx2, coeffs, degree, out, &sink);
+            printf(", avx2 %.2f ns/point (%.1fx)", avx2, old / avx2);
+        }
+#endif
+        printf("\n");
+    }
+    free(out);
+    // Keeps the fills from being optimized away.
+    return sink == 0.123;
+}
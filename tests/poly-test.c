@@ -0,0 +1,160 @@
+// Checks the pfFill variants against Horner's scheme written out for one x, which they must match
+// bit for bit, and against the power loop the server used before, which they must match within
+// the rounding error of the two evaluations. Exits with 1 on any difference.
+//
+// poly.c is included, so every variant the CPU supports is called directly.
+
+#include "../poly.c"
+
+#include <float.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "old-poly.h"
+
+#define K 10000
+#define ROUNDS 200
+#define MAX_REPORTED 20
+
+typedef void (*Fill)(const double *coeffs, size_t degree, double *out, size_t from, size_t to);
+
+static uint64_t checked;
+static uint64_t mismatches;
+// Largest difference from the power loop seen, in units of DBL_EPSILON * sum |c_i| x^i.
+static double worst;
+
+static uint64_t state = 88172645463325252ull;
+
+static uint64_t next_random(void) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static double horner(const double *coeffs, size_t degree, size_t x) {
+    double fx = coeffs[degree];
+    for (size_t i = degree; i-- > 0;) {
+        fx = fx * (double)x + coeffs[i];
+    }
+    return fx;
+}
+
+static void report(const char *variant, const char *what, size_t degree, size_t x, double got,
+                   double expected) {
+    if (mismatches++ < MAX_REPORTED) {
+        fprintf(stderr, "%s: %s for degree %zu at x=%zu: %a, expected %a\n", variant, what, degree, x,
+                got, expected);
+    }
+}
+
+// Both evaluations are off by at most about 2 * degree rounding errors of the largest term.
+static void check_against_power_loop(const char *variant, const double *coeffs, size_t degree, size_t x,
+                                     double got) {
+    double scale = 0;
+    double xi = 1;
+    for (size_t i = 0; i <= degree; i++) {
+        scale += fabs(coeffs[i]) * xi;
+        xi *= (double)x;
+    }
+    double old = old_calculate_f(degree, coeffs, x);
+    double diff = fabs(got - old);
+    if (scale > 0 && diff / (DBL_EPSILON * scale) > worst) {
+        worst = diff / (DBL_EPSILON * scale);
+    }
+    if (diff > (2 * degree + 1) * DBL_EPSILON * scale) {
+        report(variant, "power loop differs", degree, x, got, old);
+    }
+}
+
+static void check_fill(const char *variant, Fill fill, const double *coeffs, size_t degree, size_t from,
+                       size_t to, double *out) {
+    fill(coeffs, degree, out, from, to);
+    for (size_t x = from; x < to; x++) {
+        double expected = horner(coeffs, degree, x);
+        checked++;
+        if (memcmp(&out[x - from], &expected, sizeof expected) != 0) {
+            report(variant, "Horner differs", degree, x, out[x - from], expected);
+        }
+        check_against_power_loop(variant, coeffs, degree, x, out[x - from]);
+    }
+}
+
+// A coefficient as a COEFF line carries it, 7 decimals, sometimes zero or far larger.
+static double coefficient(void) {
+    double c = (double)((int64_t)(next_random() % 200000001) - 100000000) / 1e7;
+    switch (next_random() % 8) {
+        case 0: return 0;
+        case 1: return c * 1e6;
+        case 2: return c / 1e6;
+        default: return c;
+    }
+}
+
+int main(void) {
+    struct {
+        const char *name;
+        Fill fill;
+    } variants[2] = {{"generic", fill_generic}};
+    size_t variant_count = 1;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        variants[variant_count].name = "avx2";
+        variants[variant_count].fill = fill_avx2;
+        variant_count++;
+    }
+    else {
+        printf("poly-test: no AVX2, only the generic variant is checked\n");
+    }
+#endif
+
+    double *out = malloc((K + 1) * sizeof *out);
+    if (!out) {
+        return 1;
+    }
+
+    for (int r = 0; r < ROUNDS; r++) {
+        for (size_t degree = 0; degree <= MAX_N; degree++) {
+            double coeffs[MAX_N + 1];
+            for (size_t i = 0; i <= degree; i++) {
+                coeffs[i] = coefficient();
+            }
+            // Ranges of every length modulo the vector width, at the start and far from it.
+            size_t from = next_random() % 8;
+            size_t to = from + next_random() % (K + 1 - from);
+            if (r % 4 == 0) {
+                from += 1000000;
+                to = from + next_random() % 64;
+            }
+            for (size_t v = 0; v < variant_count; v++) {
+                check_fill(variants[v].name, variants[v].fill, coeffs, degree, from, to, out);
+            }
+
+            // pfFill as the callers use it, with the same range.
+            pfFill(coeffs, degree + 1, out, from, to);
+            for (size_t x = from; x < to; x++) {
+                double expected = horner(coeffs, degree, x);
+                if (memcmp(&out[x - from], &expected, sizeof expected) != 0) {
+                    report("pfFill", "Horner differs", degree, x, out[x - from], expected);
+                }
+            }
+        }
+    }
+
+    // No coefficients at all is the zero polynomial.
+    pfFill(NULL, 0, out, 0, K + 1);
+    for (size_t x = 0; x <= K; x++) {
+        if (out[x] != 0) {
+            report("pfFill", "zero polynomial differs", 0, x, out[x], 0);
+        }
+    }
+
+    free(out);
+    printf("poly-test: %" PRIu64 " values, %" PRIu64 " mismatches, power loop within %.2f eps\n", checked,
+           mismatches, worst);
+    return mismatches == 0 ? 0 : 1;
+}
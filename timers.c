@@ -0,0 +1,118 @@
+#include "timers.h"
+
+#include <stdlib.h>
+
+#include "err.h"
+
+static void place(TimerHeap *h, size_t idx, Timer t) {
+    h->heap[idx] = t;
+    *t.pos = idx;
+}
+
+static void sift_up(TimerHeap *h, size_t idx) {
+    Timer t = h->heap[idx];
+    while (idx > 0) {
+        size_t parent = (idx - 1) / 2;
+        if (h->heap[parent].deadline <= t.deadline)
+            break;
+        place(h, idx, h->heap[parent]);
+        idx = parent;
+    }
+    place(h, idx, t);
+}
+
+static void sift_down(TimerHeap *h, size_t idx) {
+    Timer t = h->heap[idx];
+    while (true) {
+        size_t left = 2 * idx + 1;
+        size_t right = left + 1;
+        size_t smallest = idx;
+        uint64_t best = t.deadline;
+
+        if (left < h->size && h->heap[left].deadline < best) {
+            smallest = left;
+            best = h->heap[left].deadline;
+        }
+        if (right < h->size && h->heap[right].deadline < best) {
+            smallest = right;
+        }
+        if (smallest == idx)
+            break;
+
+        place(h, idx, h->heap[smallest]);
+        idx = smallest;
+    }
+    place(h, idx, t);
+}
+
+void thInit(TimerHeap *h) {
+    h->heap = malloc(sizeof(Timer) * 64);
+    if (!h->heap) fatal("Out of memory");
+    h->size = 0;
+    h->capacity = 64;
+}
+
+void thDestroy(TimerHeap *h) {
+    for (size_t i = 0; i < h->size; ++i) {
+        *h->heap[i].pos = TIMER_NONE;
+    }
+    free(h->heap);
+    h->heap = NULL;
+    h->size = h->capacity = 0;
+}
+
+bool thEmpty(const TimerHeap *h) {
+    return h->size == 0;
+}
+
+// Inserts the timer or moves it when *pos says it is already scheduled.
+void thSchedule(TimerHeap *h, uint64_t handle, size_t *pos, uint64_t deadline) {
+    if (*pos != TIMER_NONE) {
+        Timer *t = &h->heap[*pos];
+        uint64_t old = t->deadline;
+        t->deadline = deadline;
+        if (deadline < old) {
+            sift_up(h, *pos);
+        } else if (deadline > old) {
+            sift_down(h, *pos);
+        }
+        return;
+    }
+
+    if (h->size + 1 > h->capacity) {
+        size_t new_cap = h->capacity * 2;
+        Timer *tmp = realloc(h->heap, new_cap * sizeof *tmp);
+        if (!tmp) fatal("Out of memory");
+        h->heap = tmp;
+        h->capacity = new_cap;
+    }
+    h->heap[h->size] = (Timer) { .deadline = deadline, .handle = handle, .pos = pos };
+    sift_up(h, h->size++);
+}
+
+void thCancel(TimerHeap *h, size_t *pos) {
+    size_t idx = *pos;
+    if (idx == TIMER_NONE) return;
+    *pos = TIMER_NONE;
+
+    Timer last = h->heap[--h->size];
+    if (idx == h->size) return;
+
+    uint64_t old = h->heap[idx].deadline;
+    place(h, idx, last);
+    if (last.deadline < old) {
+        sift_up(h, idx);
+    } else {
+        sift_down(h, idx);
+    }
+}
+
+const Timer *thPeek(const TimerHeap *h) {
+    if (h->size == 0) return NULL;
+    return &h->heap[0];
+}
+
+void thPop(TimerHeap *h) {
+    if (h->size == 0) return;
+    thCancel(h, h->heap[0].pos);
+}
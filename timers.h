@@ -0,0 +1,32 @@
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// A timer remembers where its owner keeps the timer's position, so the owner can move or cancel it.
+typedef struct {
+    uint64_t deadline;
+    uint64_t handle;
+    size_t *pos;
+} Timer;
+
+// Min-heap holding at most one deadline per client.
+typedef struct {
+    Timer *heap;
+    size_t size;
+    size_t capacity;
+} TimerHeap;
+
+#define TIMER_NONE SIZE_MAX
+
+void thInit(TimerHeap *h);
+void thDestroy(TimerHeap *h);
+bool thEmpty(const TimerHeap *h);
+void thSchedule(TimerHeap *h, uint64_t handle, size_t *pos, uint64_t deadline);
+void thCancel(TimerHeap *h, size_t *pos);
+const Timer *thPeek(const TimerHeap *h);
+void thPop(TimerHeap *h);
+
+#endif
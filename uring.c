@@ -0,0 +1,284 @@
+#define _GNU_SOURCE
+#include "uring.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "err.h"
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void unmap_rings(Uring *r) {
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring && r->cq_ring != MAP_FAILED && r->cq_ring != r->sq_ring) munmap(r->cq_ring, r->cq_ring_size);
+    if (r->sq_ring && r->sq_ring != MAP_FAILED) munmap(r->sq_ring, r->sq_ring_size);
+    if (r->buf_ring && r->buf_ring != MAP_FAILED) munmap(r->buf_ring, r->buf_ring_size);
+    free(r->buf_base);
+    if (r->fd >= 0) close(r->fd);
+    memset(r, 0, sizeof *r);
+    r->fd = -1;
+}
+
+static void add_buffer(Uring *r, uint16_t bid, unsigned offset) {
+    unsigned mask = r->buf_count - 1;
+    struct io_uring_buf *buf = &r->buf_ring->bufs[(r->buf_ring->tail + offset) & mask];
+    buf->addr = (uint64_t)(uintptr_t)urBuffer(r, bid);
+    buf->len = r->buf_size;
+    buf->bid = bid;
+}
+
+// Multishot recv needs a newer kernel than the ring itself, so it is checked on a socketpair.
+static bool probe_multishot_recv(Uring *r) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        return false;
+    }
+
+    urPrepRecvMultishot(urGetSqe(r), sv[0], 1);
+    bool ok = (write(sv[1], "x", 1) == 1) && urSubmitAndWait(r, 1, 1000) >= 0;
+
+    struct io_uring_cqe *cqe = urPeekCqe(r);
+    ok = ok && cqe && cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE);
+    if (cqe) {
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            urRecycleBuffer(r, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        bool more = cqe->flags & IORING_CQE_F_MORE;
+        urCqeSeen(r);
+
+        // Closing the peer ends the request, its last completion has to be reaped here.
+        close(sv[1]);
+        sv[1] = -1;
+        while (more && urSubmitAndWait(r, 1, 1000) >= 0 && (cqe = urPeekCqe(r))) {
+            if (cqe->flags & IORING_CQE_F_BUFFER) {
+                urRecycleBuffer(r, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            }
+            more = cqe->flags & IORING_CQE_F_MORE;
+            urCqeSeen(r);
+        }
+    }
+
+    if (sv[1] >= 0) close(sv[1]);
+    close(sv[0]);
+    return ok;
+}
+
+// Returns false when the kernel does not offer everything the server needs.
+bool urInit(Uring *r, unsigned entries, unsigned buf_count, unsigned buf_size) {
+    memset(r, 0, sizeof *r);
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof p);
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;
+
+    r->fd = sys_setup(entries, &p);
+    if (r->fd < 0 || !(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+        unmap_rings(r);
+        return false;
+    }
+
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size) r->sq_ring_size = r->cq_ring_size;
+        r->cq_ring_size = r->sq_ring_size;
+    }
+
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) {
+        unmap_rings(r);
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    }
+    else {
+        r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED) {
+            unmap_rings(r);
+            return false;
+        }
+    }
+
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        unmap_rings(r);
+        return false;
+    }
+
+    char *sq = r->sq_ring;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->sq_local_tail = *r->sq_tail;
+
+    char *cq = r->cq_ring;
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // Provided buffers for multishot recv, buf_count has to be a power of two.
+    r->buf_count = buf_count;
+    r->buf_size = buf_size;
+    r->buf_ring_size = buf_count * sizeof(struct io_uring_buf);
+    r->buf_ring = mmap(NULL, r->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    r->buf_base = malloc((size_t)buf_count * buf_size);
+    if (r->buf_ring == MAP_FAILED || !r->buf_base) {
+        unmap_rings(r);
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof reg);
+    reg.ring_addr = (uint64_t)(uintptr_t)r->buf_ring;
+    reg.ring_entries = buf_count;
+    reg.bgid = 0;
+    if (sys_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        unmap_rings(r);
+        return false;
+    }
+
+    r->buf_ring->tail = 0;
+    for (unsigned i = 0; i < buf_count; i++) {
+        add_buffer(r, (uint16_t)i, i);
+    }
+    __atomic_store_n(&r->buf_ring->tail, (uint16_t)buf_count, __ATOMIC_RELEASE);
+
+    if (!probe_multishot_recv(r)) {
+        unmap_rings(r);
+        return false;
+    }
+    return true;
+}
+
+void urDestroy(Uring *r) {
+    unmap_rings(r);
+}
+
+static void publish_sqes(Uring *r) {
+    __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+}
+
+// Returns a cleared sqe, submitting the pending ones first when the queue is full.
+struct io_uring_sqe *urGetSqe(Uring *r) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    while (r->sq_local_tail - head >= r->sq_entries) {
+        publish_sqes(r);
+        if (sys_enter(r->fd, r->sq_local_tail - head, 0, 0, NULL, 0) < 0 && errno != EINTR && errno != EBUSY) {
+            syserr("io_uring_enter");
+        }
+        head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    }
+
+    unsigned idx = r->sq_local_tail & r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof *sqe);
+    r->sq_array[idx] = idx;
+    r->sq_local_tail++;
+    return sqe;
+}
+
+// Submits everything queued and waits for wait_nr completions in a single io_uring_enter.
+int urSubmitAndWait(Uring *r, unsigned wait_nr, int timeout_ms) {
+    publish_sqes(r);
+    unsigned to_submit = r->sq_local_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+
+    if (wait_nr == 0) {
+        return sys_enter(r->fd, to_submit, 0, 0, NULL, 0);
+    }
+
+    struct __kernel_timespec ts = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_nsec = (long long)(timeout_ms % 1000) * 1000000
+    };
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof arg);
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+
+    int ret = sys_enter(r->fd, to_submit, wait_nr, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+    if (ret < 0 && (errno == ETIME || errno == EINTR)) {
+        return 0;
+    }
+    return ret;
+}
+
+struct io_uring_cqe *urPeekCqe(Uring *r) {
+    unsigned head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &r->cqes[head & r->cq_mask];
+}
+
+void urCqeSeen(Uring *r) {
+    __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+char *urBuffer(Uring *r, uint16_t bid) {
+    return r->buf_base + (size_t)bid * r->buf_size;
+}
+
+// Hands a provided buffer back to the kernel once its data has been consumed.
+void urRecycleBuffer(Uring *r, uint16_t bid) {
+    add_buffer(r, bid, 0);
+    __atomic_store_n(&r->buf_ring->tail, (uint16_t)(r->buf_ring->tail + 1), __ATOMIC_RELEASE);
+}
+
+void urPrepRecvMultishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data) {
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = user_data;
+}
+
+void urPrepSendmsg(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg, int flags, uint64_t user_data) {
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | flags;
+    sqe->user_data = user_data;
+}
+
+// Cancels the request tagged target. A request that was already running completes as usual.
+void urPrepCancel(struct io_uring_sqe *sqe, uint64_t target, uint64_t user_data) {
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+}
+
+void urPrepPollMultishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data) {
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = user_data;
+}
@@ -0,0 +1,54 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <linux/io_uring.h>
+
+struct msghdr;
+
+// Minimal io_uring wrapper on raw syscalls with one provided buffer ring (group 0).
+typedef struct {
+    int fd;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    void *cq_ring;
+    size_t cq_ring_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *buf_base;
+    unsigned buf_count;
+    unsigned buf_size;
+} Uring;
+
+bool urInit(Uring *r, unsigned entries, unsigned buf_count, unsigned buf_size);
+void urDestroy(Uring *r);
+struct io_uring_sqe *urGetSqe(Uring *r);
+int urSubmitAndWait(Uring *r, unsigned wait_nr, int timeout_ms);
+struct io_uring_cqe *urPeekCqe(Uring *r);
+void urCqeSeen(Uring *r);
+char *urBuffer(Uring *r, uint16_t bid);
+void urRecycleBuffer(Uring *r, uint16_t bid);
+
+void urPrepRecvMultishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data);
+void urPrepSendmsg(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg, int flags, uint64_t user_data);
+void urPrepCancel(struct io_uring_sqe *sqe, uint64_t target, uint64_t user_data);
+void urPrepPollMultishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <endian.h>
+#include <stdint.h>
+#include <string.h>
+
+// Binary framing, requested by the client with "HELLO <id> BIN". Every frame after that HELLO,
+// in both directions, is a type byte and a little-endian uint32 payload length, then the payload.
+// Points are uint32, values are little-endian IEEE doubles.
+//   COEFF, STATE   uint32 count, count values
+//   PUT, BAD_PUT, PENALTY   uint32 point, value
+//   SCORING        uint32 count, then per player: uint32 id length, id, score
+// "HELLO <id> BIN DELTA" additionally replaces most STATE frames with point lists:
+//   STATE_DELTA, STATE_SPARSE   uint32 count of all values, uint32 pairs, pairs of point, value
+// A delta sets the listed points of the previous state, a sparse state lists every nonzero value.
+#define HELLO_BINARY "BIN"
+#define HELLO_DELTA "BIN DELTA"
+#define FRAME_HEADER 5
+#define FRAME_POINT_VALUE 12
+#define FRAME_PAIRS 8
+
+enum {
+    FRAME_COEFF = 1,
+    FRAME_PUT,
+    FRAME_STATE,
+    FRAME_BAD_PUT,
+    FRAME_PENALTY,
+    FRAME_SCORING,
+    FRAME_STATE_DELTA,
+    FRAME_STATE_SPARSE,
+};
+
+static inline void put_u32le(char *p, uint32_t v) {
+    v = htole32(v);
+    memcpy(p, &v, sizeof v);
+}
+
+static inline uint32_t get_u32le(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    return le32toh(v);
+}
+
+static inline void put_u64le(char *p, uint64_t v) {
+    v = htole64(v);
+    memcpy(p, &v, sizeof v);
+}
+
+static inline uint64_t get_u64le(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+    return le64toh(v);
+}
+
+static inline void put_f64le(char *p, double d) {
+    uint64_t v;
+    memcpy(&v, &d, sizeof v);
+    v = htole64(v);
+    memcpy(p, &v, sizeof v);
+}
+
+static inline double get_f64le(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+    v = le64toh(v);
+    double d;
+    memcpy(&d, &v, sizeof d);
+    return d;
+}
+
+static inline void put_frame_header(char *p, uint8_t type, uint32_t len) {
+    p[0] = (char)type;
+    put_u32le(p + 1, len);
+}
+
+#endif